@@ -0,0 +1,143 @@
+/*
+ * Driver Core Hardware Runner
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Opens the real sensor through the libusb backend, waits for a finger
+ * and writes the captured frame to a PGM file. Device setup (open, claim)
+ * is synchronous; everything after that runs on the event loop.
+ *
+ * Build: make moc_capture
+ * Run: sudo ./moc_capture [output.pgm]
+ */
+
+#include <libusb-1.0/libusb.h>
+#include <stdio.h>
+
+#include "realtek_moc.h"
+
+typedef struct {
+    int done;
+    int error;
+} op_result_t;
+
+static void op_cb(moc_device_t *dev, int error, void *user_data) {
+    op_result_t *result = user_data;
+    (void)dev;
+    result->done = 1;
+    result->error = error;
+}
+
+static int run_until_done(moc_usb_t *usb, op_result_t *result) {
+    while (!result->done) {
+        int ret = moc_usb_handle_events(usb, -1);
+        if (ret == MOC_ERROR_IDLE) {
+            return ret;
+        }
+    }
+    return result->error;
+}
+
+static int write_pgm(const char *path, const unsigned char *image) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+    fprintf(f, "P5\n%d %d\n255\n", MOC_IMAGE_WIDTH, MOC_IMAGE_HEIGHT);
+    fwrite(image, 1, MOC_IMAGE_SIZE, f);
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = argc > 1 ? argv[1] : "capture.pgm";
+    libusb_context *ctx = NULL;
+    libusb_device_handle *handle = NULL;
+    op_result_t result = { 0 };
+    int ret;
+
+    printf("Driver Core Capture for Realtek 2541:fa03\n");
+    printf("=========================================\n\n");
+
+    ret = libusb_init(&ctx);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to initialize libusb: %s\n", libusb_error_name(ret));
+        return 1;
+    }
+
+    handle = libusb_open_device_with_vid_pid(ctx, MOC_VID, MOC_PID);
+    if (!handle) {
+        fprintf(stderr, "Failed to open device %04X:%04X\n", MOC_VID, MOC_PID);
+        libusb_exit(ctx);
+        return 1;
+    }
+    if (libusb_kernel_driver_active(handle, 0) == 1) {
+        libusb_detach_kernel_driver(handle, 0);
+    }
+    ret = libusb_claim_interface(handle, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to claim interface: %s\n", libusb_error_name(ret));
+        libusb_close(handle);
+        libusb_exit(ctx);
+        return 1;
+    }
+
+    moc_usb_t *usb = moc_usb_libusb_new(ctx, handle);
+    moc_device_t *dev = usb ? moc_device_new(usb) : NULL;
+    int status = 1;
+    if (!dev) {
+        fprintf(stderr, "Out of memory\n");
+        goto cleanup;
+    }
+
+    ret = moc_device_open(dev, op_cb, &result);
+    if (ret == MOC_SUCCESS) {
+        ret = run_until_done(usb, &result);
+    }
+    if (ret < 0) {
+        printf("Open failed: %s\n", moc_strerror(ret));
+        goto out;
+    }
+
+    const moc_identity_t *id = moc_device_get_identity(dev);
+    const moc_timing_t *timing = moc_device_get_timing(dev);
+    printf("Identity: vendor 0x%04X, model 0x%04X, firmware 0x%04X\n",
+           id->vendor, id->model, id->firmware);
+    printf("Property: %s\n", moc_device_get_property(dev));
+    printf("Status: 0x%08X\n", moc_device_get_status(dev));
+    printf("Open-to-ready: %.3f ms\n", (timing->ready_us - timing->open_start_us) / 1000.0);
+
+    printf("\nPlace your finger on the sensor...\n");
+    result.done = 0;
+    ret = moc_device_capture(dev, op_cb, &result);
+    if (ret == MOC_SUCCESS) {
+        ret = run_until_done(usb, &result);
+    }
+    if (ret < 0) {
+        printf("Capture failed: %s\n", moc_strerror(ret));
+        goto out;
+    }
+
+    printf("Touch-to-image: %.3f ms\n", (timing->image_us - timing->touch_us) / 1000.0);
+    if (write_pgm(output, moc_device_get_image(dev)) < 0) {
+        printf("Failed to write %s\n", output);
+        goto out;
+    }
+    printf("Image written to %s\n", output);
+    status = 0;
+
+out:
+    result.done = 0;
+    moc_device_close(dev, op_cb, &result);
+    run_until_done(usb, &result);
+
+    moc_device_free(dev);
+cleanup:
+    if (usb) {
+        moc_usb_free(usb);
+    }
+    libusb_release_interface(handle, 0);
+    libusb_close(handle);
+    libusb_exit(ctx);
+    return status;
+}
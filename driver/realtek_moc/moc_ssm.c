@@ -0,0 +1,102 @@
+/*
+ * Sequential State Machine
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * With TRACE=1 every state and the machine as a whole show up as spans,
+ * so a trace shows which step of open/capture the time went to.
+ */
+
+#include "moc_ssm.h"
+
+#include <stdlib.h>
+
+#include "moc_usb.h"
+#include "trace.h"
+
+struct moc_ssm {
+    void *dev;
+    const char *name;
+    moc_ssm_handler_fn handler;
+    moc_ssm_completed_fn callback;
+    int nr_states;
+    int cur_state;
+    uint64_t start_us;
+    uint64_t state_start_us;
+};
+
+moc_ssm_t *moc_ssm_new(void *dev, moc_ssm_handler_fn handler, int nr_states,
+                       const char *name) {
+    moc_ssm_t *ssm = calloc(1, sizeof(*ssm));
+    if (!ssm) {
+        return NULL;
+    }
+    ssm->dev = dev;
+    ssm->handler = handler;
+    ssm->nr_states = nr_states;
+    ssm->name = name;
+    return ssm;
+}
+
+static void ssm_enter_state(moc_ssm_t *ssm, int state) {
+    ssm->cur_state = state;
+    ssm->state_start_us = TRACE_NOW();
+    ssm->handler(ssm, ssm->dev);
+}
+
+static void ssm_leave_state(moc_ssm_t *ssm) {
+    TRACE_COMPLETEF("ssm", ssm->name, ssm->state_start_us, "state %d", ssm->cur_state);
+    (void)ssm;
+}
+
+void moc_ssm_start(moc_ssm_t *ssm, moc_ssm_completed_fn callback) {
+    ssm->callback = callback;
+    ssm->start_us = TRACE_NOW();
+    ssm_enter_state(ssm, 0);
+}
+
+static void ssm_finish(moc_ssm_t *ssm, int error) {
+    ssm_leave_state(ssm);
+
+    TRACE_COMPLETEF("ssm", ssm->name, ssm->start_us, "%s at state %d",
+                    moc_strerror(error), ssm->cur_state);
+
+    if (ssm->callback) {
+        ssm->callback(ssm, ssm->dev, error);
+    }
+    free(ssm);
+}
+
+void moc_ssm_next_state(moc_ssm_t *ssm) {
+    if (ssm->cur_state + 1 >= ssm->nr_states) {
+        moc_ssm_mark_completed(ssm);
+        return;
+    }
+    ssm_leave_state(ssm);
+    ssm_enter_state(ssm, ssm->cur_state + 1);
+}
+
+void moc_ssm_jump_to_state(moc_ssm_t *ssm, int state) {
+    if (state < 0 || state >= ssm->nr_states) {
+        moc_ssm_mark_failed(ssm, MOC_ERROR_PROTOCOL);
+        return;
+    }
+    ssm_leave_state(ssm);
+    ssm_enter_state(ssm, state);
+}
+
+void moc_ssm_mark_completed(moc_ssm_t *ssm) {
+    ssm_finish(ssm, MOC_SUCCESS);
+}
+
+void moc_ssm_mark_failed(moc_ssm_t *ssm, int error) {
+    ssm_finish(ssm, error);
+}
+
+int moc_ssm_get_cur_state(const moc_ssm_t *ssm) {
+    return ssm->cur_state;
+}
+
+const char *moc_ssm_get_name(const moc_ssm_t *ssm) {
+    return ssm->name;
+}
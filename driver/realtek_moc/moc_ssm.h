@@ -0,0 +1,38 @@
+/*
+ * Sequential State Machine
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * A trimmed-down copy of libfprint's FpiSsm so the driver can be dropped
+ * into libfprint with a mechanical rename. The handler is called on entry
+ * to every state; it starts one asynchronous step and returns. The step's
+ * callback then calls moc_ssm_next_state(), moc_ssm_jump_to_state(),
+ * moc_ssm_mark_completed() or moc_ssm_mark_failed().
+ *
+ * The completion callback runs exactly once and the machine is freed
+ * right after it returns.
+ */
+
+#ifndef MOC_SSM_H
+#define MOC_SSM_H
+
+#include <stdint.h>
+
+typedef struct moc_ssm moc_ssm_t;
+
+typedef void (*moc_ssm_handler_fn)(moc_ssm_t *ssm, void *dev);
+typedef void (*moc_ssm_completed_fn)(moc_ssm_t *ssm, void *dev, int error);
+
+moc_ssm_t *moc_ssm_new(void *dev, moc_ssm_handler_fn handler, int nr_states,
+                       const char *name);
+void moc_ssm_start(moc_ssm_t *ssm, moc_ssm_completed_fn callback);
+
+void moc_ssm_next_state(moc_ssm_t *ssm);
+void moc_ssm_jump_to_state(moc_ssm_t *ssm, int state);
+void moc_ssm_mark_completed(moc_ssm_t *ssm);
+void moc_ssm_mark_failed(moc_ssm_t *ssm, int error);
+
+int moc_ssm_get_cur_state(const moc_ssm_t *ssm);
+const char *moc_ssm_get_name(const moc_ssm_t *ssm);
+
+#endif
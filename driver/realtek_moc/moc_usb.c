@@ -0,0 +1,218 @@
+/*
+ * Asynchronous USB Transfer Layer
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Backend-independent half: transfer lifetime, timers and the event loop
+ * step. Each transfer records a submit->complete span and a callback span
+ * when built with TRACE=1.
+ */
+
+#include "moc_usb.h"
+
+#include <stdlib.h>
+
+#include "trace.h"
+
+struct moc_timeout {
+    uint64_t deadline_us;
+    moc_timeout_cb callback;
+    void *user_data;
+    moc_timeout_t *next;
+};
+
+const char *moc_strerror(int error) {
+    switch (error) {
+        case MOC_SUCCESS: return "success";
+        case MOC_ERROR_IO: return "I/O error";
+        case MOC_ERROR_TIMEOUT: return "timed out";
+        case MOC_ERROR_PIPE: return "request stalled";
+        case MOC_ERROR_CANCELLED: return "cancelled";
+        case MOC_ERROR_NO_DEVICE: return "no device";
+        case MOC_ERROR_PROTOCOL: return "protocol error";
+        case MOC_ERROR_NOT_SUPPORTED: return "device not supported";
+        case MOC_ERROR_BUSY: return "busy";
+        case MOC_ERROR_NO_MEM: return "out of memory";
+        case MOC_ERROR_IDLE: return "no pending events";
+    }
+    return "unknown error";
+}
+
+#ifdef ENABLE_TRACE
+static const char *xfer_name(const moc_transfer_t *xfer) {
+    switch (xfer->type) {
+        case MOC_XFER_CONTROL_IN: return "control_in";
+        case MOC_XFER_BULK_IN: return "bulk_in";
+        case MOC_XFER_INTERRUPT_IN: return "interrupt_in";
+    }
+    return "transfer";
+}
+#endif
+
+static moc_transfer_t *transfer_new(moc_usb_t *usb, moc_xfer_type_t type, int length) {
+    moc_transfer_t *xfer = calloc(1, sizeof(*xfer));
+    if (!xfer) {
+        return NULL;
+    }
+    xfer->buffer = calloc(1, length > 0 ? length : 1);
+    if (!xfer->buffer) {
+        free(xfer);
+        return NULL;
+    }
+    xfer->usb = usb;
+    xfer->type = type;
+    xfer->length = length;
+    return xfer;
+}
+
+static void transfer_free(moc_transfer_t *xfer) {
+    free(xfer->buffer);
+    free(xfer);
+}
+
+moc_transfer_t *moc_transfer_new_control_in(moc_usb_t *usb, uint8_t request, uint16_t value,
+                                            uint16_t index, int length) {
+    moc_transfer_t *xfer = transfer_new(usb, MOC_XFER_CONTROL_IN, length);
+    if (xfer) {
+        xfer->request = request;
+        xfer->value = value;
+        xfer->index = index;
+    }
+    return xfer;
+}
+
+moc_transfer_t *moc_transfer_new_bulk_in(moc_usb_t *usb, uint8_t endpoint, int length) {
+    moc_transfer_t *xfer = transfer_new(usb, MOC_XFER_BULK_IN, length);
+    if (xfer) {
+        xfer->endpoint = endpoint;
+    }
+    return xfer;
+}
+
+moc_transfer_t *moc_transfer_new_interrupt_in(moc_usb_t *usb, uint8_t endpoint, int length) {
+    moc_transfer_t *xfer = transfer_new(usb, MOC_XFER_INTERRUPT_IN, length);
+    if (xfer) {
+        xfer->endpoint = endpoint;
+    }
+    return xfer;
+}
+
+int moc_transfer_submit(moc_transfer_t *xfer, unsigned int timeout_ms,
+                        moc_transfer_cb callback, void *user_data) {
+    moc_usb_t *usb = xfer->usb;
+
+    xfer->timeout_ms = timeout_ms;
+    xfer->callback = callback;
+    xfer->user_data = user_data;
+    xfer->error = MOC_SUCCESS;
+    xfer->actual_length = 0;
+    xfer->submit_us = TRACE_NOW();
+
+    TRACE_INSTANTF("transfer", "submit", "%s ep=0x%02X req=0x%02X value=0x%04X len=%d",
+                   xfer_name(xfer), xfer->endpoint, xfer->request, xfer->value, xfer->length);
+
+    int ret = usb->ops->submit(usb, xfer);
+    if (ret < 0) {
+        transfer_free(xfer);
+        return ret;
+    }
+    usb->in_flight++;
+    return MOC_SUCCESS;
+}
+
+int moc_transfer_cancel(moc_transfer_t *xfer) {
+    return xfer->usb->ops->cancel(xfer->usb, xfer);
+}
+
+void moc_transfer_complete(moc_transfer_t *xfer, int error, int actual_length) {
+    moc_usb_t *usb = xfer->usb;
+
+    xfer->error = error;
+    xfer->actual_length = actual_length;
+    usb->in_flight--;
+
+    TRACE_COMPLETEF("transfer", xfer_name(xfer), xfer->submit_us, "ep=0x%02X req=0x%02X %d bytes: %s",
+                    xfer->endpoint, xfer->request, actual_length, moc_strerror(error));
+
+    TRACE_BEGIN("callback", xfer_name(xfer));
+    if (xfer->callback) {
+        xfer->callback(xfer, xfer->user_data);
+    }
+    TRACE_END();
+
+    transfer_free(xfer);
+}
+
+moc_timeout_t *moc_usb_add_timeout(moc_usb_t *usb, unsigned int timeout_ms,
+                                   moc_timeout_cb callback, void *user_data) {
+    moc_timeout_t *timeout = calloc(1, sizeof(*timeout));
+    if (!timeout) {
+        return NULL;
+    }
+    timeout->deadline_us = moc_usb_now_us(usb) + (uint64_t)timeout_ms * 1000;
+    timeout->callback = callback;
+    timeout->user_data = user_data;
+
+    moc_timeout_t **link = &usb->timeouts;
+    while (*link && (*link)->deadline_us <= timeout->deadline_us) {
+        link = &(*link)->next;
+    }
+    timeout->next = *link;
+    *link = timeout;
+    return timeout;
+}
+
+void moc_usb_remove_timeout(moc_usb_t *usb, moc_timeout_t *timeout) {
+    for (moc_timeout_t **link = &usb->timeouts; *link; link = &(*link)->next) {
+        if (*link == timeout) {
+            *link = timeout->next;
+            free(timeout);
+            return;
+        }
+    }
+}
+
+uint64_t moc_usb_now_us(moc_usb_t *usb) {
+    return usb->ops->now_us(usb);
+}
+
+int moc_usb_handle_events(moc_usb_t *usb, int timeout_ms) {
+    if (usb->in_flight == 0 && !usb->timeouts) {
+        return MOC_ERROR_IDLE;
+    }
+
+    // Never sleep past the next timer
+    int wait_ms = timeout_ms;
+    if (usb->timeouts) {
+        uint64_t now = moc_usb_now_us(usb);
+        uint64_t deadline = usb->timeouts->deadline_us;
+        int until_ms = deadline > now ? (int)((deadline - now + 999) / 1000) : 0;
+        if (wait_ms < 0 || until_ms < wait_ms) {
+            wait_ms = until_ms;
+        }
+    }
+
+    int ret = usb->ops->wait(usb, wait_ms);
+
+    uint64_t now = moc_usb_now_us(usb);
+    while (usb->timeouts && usb->timeouts->deadline_us <= now) {
+        moc_timeout_t *timeout = usb->timeouts;
+        usb->timeouts = timeout->next;
+
+        TRACE_BEGIN("callback", "timeout");
+        timeout->callback(timeout->user_data);
+        TRACE_END();
+        free(timeout);
+    }
+
+    return ret;
+}
+
+void moc_usb_free(moc_usb_t *usb) {
+    while (usb->timeouts) {
+        moc_timeout_t *timeout = usb->timeouts;
+        usb->timeouts = timeout->next;
+        free(timeout);
+    }
+    usb->ops->destroy(usb);
+}
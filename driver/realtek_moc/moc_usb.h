@@ -0,0 +1,111 @@
+/*
+ * Asynchronous USB Transfer Layer
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Mirrors the shape of libfprint's FpiUsbTransfer: the driver allocates a
+ * transfer, submits it with a callback, and the callback runs from
+ * moc_usb_handle_events() once the transfer completes, fails, times out
+ * or is cancelled. The transfer is freed after its callback returns.
+ *
+ * Nothing here blocks except moc_usb_handle_events(), which is the main
+ * loop's single wait point. Backends:
+ *   - moc_usb_libusb.c: real device via the libusb asynchronous API
+ *   - moc_usb_sim.c:    simulated device on a virtual clock (no libusb)
+ */
+
+#ifndef MOC_USB_H
+#define MOC_USB_H
+
+#include <stdint.h>
+
+// Error codes shared by the whole driver core (0 = success)
+enum {
+    MOC_SUCCESS = 0,
+    MOC_ERROR_IO = -1,
+    MOC_ERROR_TIMEOUT = -2,
+    MOC_ERROR_PIPE = -3,            // Request stalled by the device
+    MOC_ERROR_CANCELLED = -4,
+    MOC_ERROR_NO_DEVICE = -5,
+    MOC_ERROR_PROTOCOL = -6,        // Unexpected response contents
+    MOC_ERROR_NOT_SUPPORTED = -7,   // Identity check failed
+    MOC_ERROR_BUSY = -8,
+    MOC_ERROR_NO_MEM = -9,
+    MOC_ERROR_IDLE = -10,           // Nothing left that could ever complete
+};
+
+const char *moc_strerror(int error);
+
+typedef struct moc_usb moc_usb_t;
+typedef struct moc_transfer moc_transfer_t;
+typedef struct moc_timeout moc_timeout_t;
+
+typedef void (*moc_transfer_cb)(moc_transfer_t *xfer, void *user_data);
+typedef void (*moc_timeout_cb)(void *user_data);
+
+typedef enum {
+    MOC_XFER_CONTROL_IN,    // Vendor device-to-host request (bmRequestType 0xC0)
+    MOC_XFER_BULK_IN,
+    MOC_XFER_INTERRUPT_IN,
+} moc_xfer_type_t;
+
+struct moc_transfer {
+    moc_usb_t *usb;
+    moc_xfer_type_t type;
+    uint8_t endpoint;           // 0x00 for control transfers
+    uint8_t request;            // Control only
+    uint16_t value;             // Control only
+    uint16_t index;             // Control only
+    unsigned char *buffer;
+    int length;
+    int actual_length;
+    unsigned int timeout_ms;    // 0 = wait forever
+    int error;                  // MOC_SUCCESS or MOC_ERROR_*
+    moc_transfer_cb callback;
+    void *user_data;
+    uint64_t submit_us;
+    void *priv;                 // Backend state
+};
+
+typedef struct {
+    int (*submit)(moc_usb_t *usb, moc_transfer_t *xfer);
+    int (*cancel)(moc_usb_t *usb, moc_transfer_t *xfer);
+    // Dispatch completions, waiting at most timeout_ms (-1 = no limit)
+    int (*wait)(moc_usb_t *usb, int timeout_ms);
+    uint64_t (*now_us)(moc_usb_t *usb);
+    void (*destroy)(moc_usb_t *usb);
+} moc_usb_ops_t;
+
+struct moc_usb {
+    const moc_usb_ops_t *ops;
+    void *backend;
+    moc_timeout_t *timeouts;    // Sorted by deadline
+    int in_flight;
+};
+
+moc_transfer_t *moc_transfer_new_control_in(moc_usb_t *usb, uint8_t request, uint16_t value,
+                                            uint16_t index, int length);
+moc_transfer_t *moc_transfer_new_bulk_in(moc_usb_t *usb, uint8_t endpoint, int length);
+moc_transfer_t *moc_transfer_new_interrupt_in(moc_usb_t *usb, uint8_t endpoint, int length);
+// Takes ownership: on failure the transfer is freed and the error returned
+int moc_transfer_submit(moc_transfer_t *xfer, unsigned int timeout_ms,
+                        moc_transfer_cb callback, void *user_data);
+int moc_transfer_cancel(moc_transfer_t *xfer);
+
+// Called by backends when a transfer finishes; runs the callback and frees it
+void moc_transfer_complete(moc_transfer_t *xfer, int error, int actual_length);
+
+// One-shot timer; the handle is freed once the callback has run
+moc_timeout_t *moc_usb_add_timeout(moc_usb_t *usb, unsigned int timeout_ms,
+                                   moc_timeout_cb callback, void *user_data);
+void moc_usb_remove_timeout(moc_usb_t *usb, moc_timeout_t *timeout);
+
+uint64_t moc_usb_now_us(moc_usb_t *usb);
+int moc_usb_handle_events(moc_usb_t *usb, int timeout_ms);
+void moc_usb_free(moc_usb_t *usb);
+
+struct libusb_context;
+struct libusb_device_handle;
+moc_usb_t *moc_usb_libusb_new(struct libusb_context *ctx, struct libusb_device_handle *handle);
+
+#endif
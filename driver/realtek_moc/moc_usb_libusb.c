@@ -0,0 +1,160 @@
+/*
+ * libusb Backend
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Maps moc_transfer_t onto libusb's asynchronous API. Completions are
+ * delivered from libusb_handle_events_timeout_completed(), which is the
+ * only place the main loop waits. The caller opens the device and claims
+ * interface 0 before creating the backend, as libfprint does in probe.
+ */
+
+#include <libusb-1.0/libusb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "moc_usb.h"
+
+typedef struct {
+    libusb_context *ctx;
+    libusb_device_handle *handle;
+} usb_backend_t;
+
+static int map_libusb_error(int ret) {
+    switch (ret) {
+        case LIBUSB_SUCCESS: return MOC_SUCCESS;
+        case LIBUSB_ERROR_TIMEOUT: return MOC_ERROR_TIMEOUT;
+        case LIBUSB_ERROR_PIPE: return MOC_ERROR_PIPE;
+        case LIBUSB_ERROR_NO_DEVICE: return MOC_ERROR_NO_DEVICE;
+        case LIBUSB_ERROR_NO_MEM: return MOC_ERROR_NO_MEM;
+    }
+    return MOC_ERROR_IO;
+}
+
+static int map_transfer_status(enum libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_COMPLETED: return MOC_SUCCESS;
+        case LIBUSB_TRANSFER_TIMED_OUT: return MOC_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_CANCELLED: return MOC_ERROR_CANCELLED;
+        case LIBUSB_TRANSFER_STALL: return MOC_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return MOC_ERROR_NO_DEVICE;
+        default: break;
+    }
+    return MOC_ERROR_IO;
+}
+
+static void LIBUSB_CALL transfer_cb(struct libusb_transfer *transfer) {
+    moc_transfer_t *xfer = transfer->user_data;
+    int error = map_transfer_status(transfer->status);
+    int len = transfer->actual_length;
+
+    if (xfer->type == MOC_XFER_CONTROL_IN) {
+        memcpy(xfer->buffer, libusb_control_transfer_get_data(transfer), len);
+    }
+
+    xfer->priv = NULL;
+    // LIBUSB_TRANSFER_FREE_BUFFER releases the setup packet copy for control
+    libusb_free_transfer(transfer);
+    moc_transfer_complete(xfer, error, len);
+}
+
+static int usb_submit(moc_usb_t *usb, moc_transfer_t *xfer) {
+    usb_backend_t *backend = usb->backend;
+    struct libusb_transfer *transfer = libusb_alloc_transfer(0);
+    if (!transfer) {
+        return MOC_ERROR_NO_MEM;
+    }
+
+    switch (xfer->type) {
+        case MOC_XFER_CONTROL_IN: {
+            unsigned char *buf = malloc(LIBUSB_CONTROL_SETUP_SIZE + xfer->length);
+            if (!buf) {
+                libusb_free_transfer(transfer);
+                return MOC_ERROR_NO_MEM;
+            }
+            libusb_fill_control_setup(buf,
+                                      LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
+                                      xfer->request, xfer->value, xfer->index, xfer->length);
+            libusb_fill_control_transfer(transfer, backend->handle, buf, transfer_cb, xfer,
+                                         xfer->timeout_ms);
+            transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+            break;
+        }
+        case MOC_XFER_BULK_IN:
+            libusb_fill_bulk_transfer(transfer, backend->handle, xfer->endpoint, xfer->buffer,
+                                      xfer->length, transfer_cb, xfer, xfer->timeout_ms);
+            break;
+        case MOC_XFER_INTERRUPT_IN:
+            libusb_fill_interrupt_transfer(transfer, backend->handle, xfer->endpoint, xfer->buffer,
+                                           xfer->length, transfer_cb, xfer, xfer->timeout_ms);
+            break;
+    }
+
+    int ret = libusb_submit_transfer(transfer);
+    if (ret < 0) {
+        libusb_free_transfer(transfer);
+        return map_libusb_error(ret);
+    }
+    xfer->priv = transfer;
+    return MOC_SUCCESS;
+}
+
+static int usb_cancel(moc_usb_t *usb, moc_transfer_t *xfer) {
+    (void)usb;
+    if (!xfer->priv) {
+        return MOC_ERROR_IO;
+    }
+    return map_libusb_error(libusb_cancel_transfer(xfer->priv));
+}
+
+static int usb_wait(moc_usb_t *usb, int timeout_ms) {
+    usb_backend_t *backend = usb->backend;
+    struct timeval tv;
+
+    // libusb has no "forever" here; one second per iteration is plenty
+    if (timeout_ms < 0) {
+        timeout_ms = 1000;
+    }
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    return map_libusb_error(libusb_handle_events_timeout_completed(backend->ctx, &tv, NULL));
+}
+
+static uint64_t usb_now_us(moc_usb_t *usb) {
+    struct timespec ts;
+    (void)usb;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void usb_destroy(moc_usb_t *usb) {
+    free(usb->backend);
+    free(usb);
+}
+
+static const moc_usb_ops_t usb_ops = {
+    .submit = usb_submit,
+    .cancel = usb_cancel,
+    .wait = usb_wait,
+    .now_us = usb_now_us,
+    .destroy = usb_destroy,
+};
+
+moc_usb_t *moc_usb_libusb_new(struct libusb_context *ctx, struct libusb_device_handle *handle) {
+    moc_usb_t *usb = calloc(1, sizeof(*usb));
+    usb_backend_t *backend = calloc(1, sizeof(*backend));
+    if (!usb || !backend) {
+        free(usb);
+        free(backend);
+        return NULL;
+    }
+    backend->ctx = ctx;
+    backend->handle = handle;
+
+    usb->ops = &usb_ops;
+    usb->backend = backend;
+    return usb;
+}
@@ -0,0 +1,426 @@
+/*
+ * Simulated 2541:fa03 Device
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Model:
+ *   - control requests complete control_latency_us after submission
+ *   - 0x82 and 0x83 each have a FIFO of packets with a ready time; the
+ *     oldest pending IN transfer on that endpoint takes the head packet
+ *   - transfer timeouts and cancellations complete like libusb, i.e. from
+ *     the event loop and never from inside submit/cancel
+ *
+ * By default 0x82 only has data at power-up and around a capture, so a
+ * read left pending on it just waits. The real device never times out
+ * on 0x82 and answers every read with a status packet (see
+ * docs/protocol-findings.md); status_always models that, and any read
+ * the driver leaves spinning keeps the event loop from going idle.
+ */
+
+#include "moc_usb_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "realtek_moc.h"
+
+#define SIM_NEVER UINT64_MAX
+
+typedef struct sim_packet {
+    uint64_t ready_us;
+    int len;
+    unsigned char data[MOC_EP_PACKET_SIZE];
+    struct sim_packet *next;
+} sim_packet_t;
+
+typedef struct sim_pending {
+    moc_transfer_t *xfer;
+    uint64_t submitted_us;
+    uint64_t deadline_us;
+    int cancelled;
+
+    // Control transfers: response decided at submit time
+    uint64_t due_us;
+    int ctrl_error;
+    int ctrl_len;
+    unsigned char ctrl_data[MOC_PROPERTIES_LEN];
+
+    struct sim_pending *next;
+} sim_pending_t;
+
+typedef struct {
+    moc_sim_config_t config;
+    uint64_t now_us;
+    sim_packet_t *status_queue;     // 0x82
+    sim_packet_t *finger_queue;     // 0x83
+    sim_pending_t *pending;         // Submission order
+    unsigned int status_errors;     // 0x82 reads left to fail
+    unsigned int status_reads;      // 0x82 reads submitted
+} sim_t;
+
+static const unsigned char sim_identity[MOC_IDENTITY_LEN] = {
+    0xDA, 0x0B, 0x13, 0x58, 0x00, 0x00, 0x32, 0x00
+};
+
+static const unsigned char sim_properties[MOC_PROPERTIES_LEN] = {
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x06, 0xB0, 0x01, 0x32, 0x00, 0x04, 0x00, 0x04, 0x00,
+    0x24, 0x00, 0x53, 0x00, 0x79, 0x00, 0x73, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6D, 0x00, 0x57, 0x00,
+    0x61, 0x00, 0x6B, 0x00, 0x65, 0x00, 0x45, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x62, 0x00, 0x6C, 0x00,
+    0x65, 0x00, 0x64, 0x00, 0x00, 0x00, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x32, 0x00, 0x04, 0x00,
+};
+
+static const unsigned char sim_status[] = { MOC_PKT_STATUS, 0xF7, 0xFF, 0xFF, 0xFF };
+
+void moc_sim_config_init(moc_sim_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->control_latency_us = 250;
+    config->packet_latency_us = 125;
+    config->capture_us = 40000;
+    config->chunk_us = 100;
+}
+
+unsigned char moc_usb_sim_pixel(int x, int y) {
+    // Concentric ridges, roughly fingerprint-like
+    int dx = x - MOC_IMAGE_WIDTH / 2;
+    int dy = y - MOC_IMAGE_HEIGHT / 2;
+    return ((dx * dx + dy * dy) / 40) % 2 ? 0x30 : 0xD0;
+}
+
+static sim_t *get_sim(moc_usb_t *usb) {
+    return usb->backend;
+}
+
+static void queue_packet(sim_packet_t **queue, uint64_t ready_us, const unsigned char *data, int len) {
+    sim_packet_t *pkt = calloc(1, sizeof(*pkt));
+    if (!pkt) {
+        return;
+    }
+    pkt->ready_us = ready_us;
+    pkt->len = len;
+    memcpy(pkt->data, data, len);
+
+    while (*queue) {
+        queue = &(*queue)->next;
+    }
+    *queue = pkt;
+}
+
+static void free_queue(sim_packet_t *pkt) {
+    while (pkt) {
+        sim_packet_t *next = pkt->next;
+        free(pkt);
+        pkt = next;
+    }
+}
+
+static sim_packet_t **queue_for(sim_t *sim, uint8_t endpoint) {
+    switch (endpoint) {
+        case MOC_EP_STATUS: return &sim->status_queue;
+        case MOC_EP_FINGER: return &sim->finger_queue;
+    }
+    return NULL;
+}
+
+static void sim_control_response(sim_t *sim, sim_pending_t *p) {
+    const moc_transfer_t *xfer = p->xfer;
+    const unsigned char *resp = NULL;
+    unsigned char zeros[8] = { 0 };
+    int len = 0;
+
+    p->ctrl_error = MOC_SUCCESS;
+    switch (xfer->request) {
+        case 0x06:
+        case 0x07:
+            if (xfer->value == 0) {
+                resp = sim_identity;
+                len = sizeof(sim_identity);
+            } else {
+                resp = zeros;
+                len = xfer->request == 0x06 ? 4 : 8;
+            }
+            break;
+        case MOC_REQ_PROPERTIES:
+            if (sim->config.stall_properties) {
+                p->ctrl_error = MOC_ERROR_PIPE;
+            }
+            resp = sim_properties;
+            len = sizeof(sim_properties);
+            break;
+        default:
+            p->ctrl_error = MOC_ERROR_PIPE;
+            break;
+    }
+
+    if (len > xfer->length) {
+        len = xfer->length;
+    }
+    if (p->ctrl_error == MOC_SUCCESS && len > 0) {
+        memcpy(p->ctrl_data, resp, len);
+        if (sim->config.bad_identity && resp == sim_identity) {
+            p->ctrl_data[0] ^= 0xFF;
+        }
+        p->ctrl_len = len;
+    }
+}
+
+static int sim_submit(moc_usb_t *usb, moc_transfer_t *xfer) {
+    sim_t *sim = get_sim(usb);
+
+    if (xfer->type != MOC_XFER_CONTROL_IN && !queue_for(sim, xfer->endpoint)) {
+        return MOC_ERROR_PIPE;
+    }
+
+    sim_pending_t *p = calloc(1, sizeof(*p));
+    if (!p) {
+        return MOC_ERROR_NO_MEM;
+    }
+    p->xfer = xfer;
+    p->submitted_us = sim->now_us;
+    if (xfer->type != MOC_XFER_CONTROL_IN && xfer->endpoint == MOC_EP_STATUS) {
+        sim->status_reads++;
+    }
+    p->deadline_us = xfer->timeout_ms ? sim->now_us + (uint64_t)xfer->timeout_ms * 1000 : SIM_NEVER;
+    p->due_us = SIM_NEVER;
+    if (xfer->type == MOC_XFER_CONTROL_IN) {
+        p->due_us = sim->now_us + sim->config.control_latency_us;
+        sim_control_response(sim, p);
+    }
+
+    sim_pending_t **link = &sim->pending;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = p;
+    xfer->priv = p;
+    return MOC_SUCCESS;
+}
+
+static int sim_cancel(moc_usb_t *usb, moc_transfer_t *xfer) {
+    for (sim_pending_t *p = get_sim(usb)->pending; p; p = p->next) {
+        if (p->xfer == xfer) {
+            p->cancelled = 1;
+            return MOC_SUCCESS;
+        }
+    }
+    return MOC_ERROR_IO;
+}
+
+// Earliest time this transfer can complete, and with which packet
+static uint64_t sim_event_time(sim_t *sim, sim_pending_t *p, int *first_on_ep) {
+    uint64_t t = p->deadline_us;
+
+    if (p->cancelled) {
+        return sim->now_us;
+    }
+    if (p->xfer->type == MOC_XFER_CONTROL_IN) {
+        return p->due_us < t ? p->due_us : t;
+    }
+
+    sim_packet_t *head = *queue_for(sim, p->xfer->endpoint);
+    int answers = p->xfer->endpoint == MOC_EP_STATUS &&
+                  (sim->config.status_always || sim->status_errors);
+    if ((head || answers) && *first_on_ep) {
+        // A device that always answers never holds a read back for a packet
+        uint64_t ready = p->submitted_us;
+        if (!answers && head->ready_us > ready) {
+            ready = head->ready_us;
+        }
+        ready += sim->config.packet_latency_us;
+        if (ready < t) {
+            t = ready;
+        }
+    }
+    *first_on_ep = 0;
+    return t;
+}
+
+static sim_pending_t *sim_next_event(sim_t *sim, uint64_t *when) {
+    sim_pending_t *best = NULL;
+    int status_first = 1;
+    int finger_first = 1;
+
+    *when = SIM_NEVER;
+    for (sim_pending_t *p = sim->pending; p; p = p->next) {
+        int unused = 1;
+        int *first = &unused;
+        if (p->xfer->endpoint == MOC_EP_STATUS) {
+            first = &status_first;
+        } else if (p->xfer->endpoint == MOC_EP_FINGER) {
+            first = &finger_first;
+        }
+
+        uint64_t t = sim_event_time(sim, p, first);
+        if (t < *when) {
+            *when = t;
+            best = p;
+        }
+    }
+    return best;
+}
+
+static void sim_dispatch(sim_t *sim, sim_pending_t *p) {
+    moc_transfer_t *xfer = p->xfer;
+    int error = MOC_SUCCESS;
+    int len = 0;
+
+    for (sim_pending_t **link = &sim->pending; *link; link = &(*link)->next) {
+        if (*link == p) {
+            *link = p->next;
+            break;
+        }
+    }
+
+    if (p->cancelled) {
+        error = MOC_ERROR_CANCELLED;
+    } else if (xfer->type == MOC_XFER_CONTROL_IN) {
+        if (p->due_us <= sim->now_us) {
+            error = p->ctrl_error;
+            len = p->ctrl_len;
+            memcpy(xfer->buffer, p->ctrl_data, len);
+        } else {
+            error = MOC_ERROR_TIMEOUT;
+        }
+    } else {
+        sim_packet_t **queue = queue_for(sim, xfer->endpoint);
+        sim_packet_t *head = *queue;
+        int status_ep = xfer->endpoint == MOC_EP_STATUS;
+        if (status_ep && sim->status_errors) {
+            sim->status_errors--;
+            error = MOC_ERROR_IO;
+        } else if (head && head->ready_us + sim->config.packet_latency_us <= sim->now_us) {
+            *queue = head->next;
+            len = head->len < xfer->length ? head->len : xfer->length;
+            memcpy(xfer->buffer, head->data, len);
+            free(head);
+        } else if (status_ep && sim->config.status_always) {
+            len = sizeof(sim_status) < (size_t)xfer->length ? (int)sizeof(sim_status) : xfer->length;
+            memcpy(xfer->buffer, sim_status, len);
+        } else {
+            error = MOC_ERROR_TIMEOUT;
+        }
+    }
+
+    xfer->priv = NULL;
+    free(p);
+    moc_transfer_complete(xfer, error, len);
+}
+
+static int sim_wait(moc_usb_t *usb, int timeout_ms) {
+    sim_t *sim = get_sim(usb);
+    uint64_t limit = timeout_ms < 0 ? SIM_NEVER : sim->now_us + (uint64_t)timeout_ms * 1000;
+    uint64_t when;
+
+    // Transfers that are waiting forever on an empty queue cannot wake us
+    sim_pending_t *p = sim_next_event(sim, &when);
+    if (when == SIM_NEVER && timeout_ms < 0) {
+        return MOC_ERROR_IDLE;
+    }
+    if (when > limit) {
+        sim->now_us = limit;
+        return MOC_SUCCESS;
+    }
+
+    // Everything due at this instant, including work submitted by callbacks
+    if (when > sim->now_us) {
+        sim->now_us = when;
+    }
+    while (p && when <= sim->now_us) {
+        sim_dispatch(sim, p);
+        p = sim_next_event(sim, &when);
+    }
+    return MOC_SUCCESS;
+}
+
+static uint64_t sim_now_us(moc_usb_t *usb) {
+    return get_sim(usb)->now_us;
+}
+
+static void sim_destroy(moc_usb_t *usb) {
+    sim_t *sim = get_sim(usb);
+
+    while (sim->pending) {
+        sim_pending_t *next = sim->pending->next;
+        free(sim->pending);
+        sim->pending = next;
+    }
+    free_queue(sim->status_queue);
+    free_queue(sim->finger_queue);
+    free(sim);
+    free(usb);
+}
+
+static const moc_usb_ops_t sim_ops = {
+    .submit = sim_submit,
+    .cancel = sim_cancel,
+    .wait = sim_wait,
+    .now_us = sim_now_us,
+    .destroy = sim_destroy,
+};
+
+moc_usb_t *moc_usb_sim_new(const moc_sim_config_t *config) {
+    moc_usb_t *usb = calloc(1, sizeof(*usb));
+    sim_t *sim = calloc(1, sizeof(*sim));
+    if (!usb || !sim) {
+        free(usb);
+        free(sim);
+        return NULL;
+    }
+
+    if (config) {
+        sim->config = *config;
+    } else {
+        moc_sim_config_init(&sim->config);
+    }
+    if (!sim->config.silent_status) {
+        queue_packet(&sim->status_queue, 0, sim_status, sizeof(sim_status));
+    }
+
+    usb->ops = &sim_ops;
+    usb->backend = sim;
+    return usb;
+}
+
+void moc_usb_sim_configure(moc_usb_t *usb, const moc_sim_config_t *config) {
+    get_sim(usb)->config = *config;
+}
+
+unsigned int moc_usb_sim_status_reads(moc_usb_t *usb) {
+    return get_sim(usb)->status_reads;
+}
+
+void moc_usb_sim_fail_status_reads(moc_usb_t *usb, unsigned int count) {
+    get_sim(usb)->status_errors = count;
+}
+
+void moc_usb_sim_touch(moc_usb_t *usb, unsigned int after_ms) {
+    sim_t *sim = get_sim(usb);
+    uint64_t touch_us = sim->now_us + (uint64_t)after_ms * 1000;
+    unsigned char finger_on[MOC_INT_PACKET_SIZE] = { MOC_FINGER_ON };
+    unsigned char finger_off[MOC_INT_PACKET_SIZE] = { MOC_FINGER_OFF };
+    unsigned char pkt[MOC_EP_PACKET_SIZE];
+    const int chunk = MOC_EP_PACKET_SIZE - MOC_PKT_IMAGE_HEADER;
+
+    queue_packet(&sim->finger_queue, touch_us, finger_on, sizeof(finger_on));
+
+    uint64_t t = touch_us + sim->config.capture_us;
+    int total = sim->config.truncate_image ? MOC_IMAGE_SIZE / 2 : MOC_IMAGE_SIZE;
+    int seq = 0;
+    for (int offset = 0; offset < total; offset += chunk, seq++) {
+        int len = total - offset < chunk ? total - offset : chunk;
+
+        pkt[0] = MOC_PKT_IMAGE;
+        pkt[1] = (sim->config.corrupt_image && seq >= 3 ? seq + 1 : seq) & 0xFF;
+        pkt[2] = len & 0xFF;
+        pkt[3] = len >> 8;
+        for (int i = 0; i < len; i++) {
+            int pos = offset + i;
+            pkt[MOC_PKT_IMAGE_HEADER + i] = moc_usb_sim_pixel(pos % MOC_IMAGE_WIDTH,
+                                                              pos / MOC_IMAGE_WIDTH);
+        }
+        queue_packet(&sim->status_queue, t, pkt, MOC_PKT_IMAGE_HEADER + len);
+        t += sim->config.chunk_us;
+    }
+
+    queue_packet(&sim->status_queue, t, sim_status, sizeof(sim_status));
+    queue_packet(&sim->finger_queue, t + 100000, finger_off, sizeof(finger_off));
+}
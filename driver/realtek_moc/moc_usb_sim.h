@@ -0,0 +1,52 @@
+/*
+ * Simulated 2541:fa03 Device
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * A moc_usb_t backend that answers like the real sensor (responses copied
+ * from docs/protocol-findings.md) on a virtual clock. Waiting never
+ * sleeps: moc_usb_handle_events() jumps straight to the next event, so a
+ * full open + capture runs in microseconds and reported latencies are
+ * exact and repeatable.
+ */
+
+#ifndef MOC_USB_SIM_H
+#define MOC_USB_SIM_H
+
+#include "moc_usb.h"
+
+typedef struct {
+    unsigned int control_latency_us;    // Request to response
+    unsigned int packet_latency_us;     // Queued packet to IN completion
+    unsigned int capture_us;            // Finger-on to first image packet
+    unsigned int chunk_us;              // Between image packets
+
+    // Fault injection
+    int bad_identity;       // 0x06 returns someone else's identity
+    int stall_properties;   // 0x15 stalls
+    int silent_status;      // 0x82 never sends a status packet
+    int status_always;      // Every 0x82 read with nothing queued gets a status packet
+    int truncate_image;     // Image stream stops halfway
+    int corrupt_image;      // Image stream skips a sequence number
+} moc_sim_config_t;
+
+void moc_sim_config_init(moc_sim_config_t *config);
+moc_usb_t *moc_usb_sim_new(const moc_sim_config_t *config);
+
+// Schedule a finger touch after_ms from now on the virtual clock
+void moc_usb_sim_touch(moc_usb_t *usb, unsigned int after_ms);
+
+// Replace the configuration, e.g. to clear a fault; packets already
+// queued are not touched
+void moc_usb_sim_configure(moc_usb_t *usb, const moc_sim_config_t *config);
+
+// Number of 0x82 reads submitted so far
+unsigned int moc_usb_sim_status_reads(moc_usb_t *usb);
+
+// Fail the next count reads on 0x82 with MOC_ERROR_IO
+void moc_usb_sim_fail_status_reads(moc_usb_t *usb, unsigned int count);
+
+// Pixel the simulated sensor reports at (x, y)
+unsigned char moc_usb_sim_pixel(int x, int y);
+
+#endif
@@ -0,0 +1,829 @@
+/*
+ * Realtek/Microctopus MoC Driver Core
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Ownership rules, kept close to libfprint drivers:
+ *   - at most one open/capture SSM runs at a time (dev->ssm)
+ *   - every in-flight transfer is tracked so close can cancel it
+ *   - transfer callbacks clear their tracking pointer first, then bail out
+ *     if the device is closing
+ *   - the caller's callback for an operation runs exactly once
+ */
+
+#include "realtek_moc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "moc_ssm.h"
+#include "trace.h"
+
+enum {
+    OPEN_GET_IDENTITY,
+    OPEN_GET_PROPERTIES,
+    OPEN_READ_STATUS,
+    OPEN_NUM_STATES,
+};
+
+enum {
+    CAPTURE_ARM_FINGER,
+    CAPTURE_READ_IMAGE,
+    CAPTURE_NUM_STATES,
+};
+
+// After a capture that streamed: wait for the queued reads, then
+// discard what a failed capture left on 0x82
+enum {
+    SETTLE_STOP_STREAM,
+    SETTLE_DRAIN,
+    SETTLE_PAUSE,
+    SETTLE_NUM_STATES,
+};
+
+struct moc_device {
+    moc_usb_t *usb;
+    moc_state_t state;
+
+    moc_ssm_t *ssm;                 // Active open or capture machine
+    moc_done_cb callback;           // Caller of the active operation
+    void *user_data;
+    int open_error;
+
+    moc_done_cb close_callback;
+    void *close_user_data;
+
+    moc_transfer_t *ctrl_xfer;
+    moc_transfer_t *status_xfer;    // Single 0x82 read while opening
+    moc_transfer_t *image_xfers[MOC_IMAGE_QUEUE_DEPTH];  // Queued 0x82 reads while streaming
+    moc_transfer_t *finger_xfer;
+    moc_timeout_t *timeout;         // Wait-state timer of the active SSM
+    moc_timeout_t *poll_timeout;    // Next status read while ready
+
+    moc_identity_t identity;
+    char property[64];
+    uint32_t status;
+
+    unsigned char image[MOC_IMAGE_SIZE];
+    int image_len;
+    int image_seq;
+    int image_complete;
+    int streaming;                  // image_xfers requeue themselves while set
+    int stopping;                   // Settle waits for the 0x82 reads to finish
+    int capture_error;              // Reported once settle is done
+
+    moc_timing_t timing;
+};
+
+static uint16_t get_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void report(moc_device_t *dev, int error) {
+    moc_done_cb callback = dev->callback;
+    void *user_data = dev->user_data;
+
+    dev->callback = NULL;
+    dev->user_data = NULL;
+    if (callback) {
+        callback(dev, error, user_data);
+    }
+}
+
+static void clear_timeout(moc_device_t *dev) {
+    if (dev->timeout) {
+        moc_usb_remove_timeout(dev->usb, dev->timeout);
+        dev->timeout = NULL;
+    }
+}
+
+static void ssm_timeout_cb(void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->timeout = NULL;
+    if (dev->ssm) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_TIMEOUT);
+    }
+}
+
+static void ssm_wait(moc_device_t *dev, unsigned int timeout_ms) {
+    dev->timeout = moc_usb_add_timeout(dev->usb, timeout_ms, ssm_timeout_cb, dev);
+    if (!dev->timeout) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_NO_MEM);
+    }
+}
+
+// Submit and track a transfer; returns 0 or an error for the SSM to fail with
+static int submit_tracked(moc_device_t *dev, moc_transfer_t **slot, moc_transfer_t *xfer,
+                          unsigned int timeout_ms, moc_transfer_cb callback) {
+    if (!xfer) {
+        return MOC_ERROR_NO_MEM;
+    }
+    *slot = xfer;
+    int ret = moc_transfer_submit(xfer, timeout_ms, callback, dev);
+    if (ret < 0) {
+        *slot = NULL;
+    }
+    return ret;
+}
+
+static int image_reads_pending(const moc_device_t *dev) {
+    for (int i = 0; i < MOC_IMAGE_QUEUE_DEPTH; i++) {
+        if (dev->image_xfers[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int transfers_in_flight(const moc_device_t *dev) {
+    return dev->ctrl_xfer || dev->status_xfer || dev->finger_xfer || image_reads_pending(dev);
+}
+
+static void check_close_done(moc_device_t *dev) {
+    if (dev->state != MOC_STATE_CLOSING || transfers_in_flight(dev)) {
+        return;
+    }
+
+    moc_done_cb callback = dev->close_callback;
+    void *user_data = dev->close_user_data;
+
+    dev->state = MOC_STATE_CLOSED;
+    dev->close_callback = NULL;
+    dev->close_user_data = NULL;
+    if (callback) {
+        callback(dev, MOC_SUCCESS, user_data);
+    }
+}
+
+static void image_stream_stop(moc_device_t *dev);
+static void status_watch_stop(moc_device_t *dev);
+
+static void begin_close(moc_device_t *dev, moc_done_cb callback, void *user_data) {
+    dev->state = MOC_STATE_CLOSING;
+    dev->close_callback = callback;
+    dev->close_user_data = user_data;
+
+    clear_timeout(dev);
+    if (dev->ctrl_xfer) {
+        moc_transfer_cancel(dev->ctrl_xfer);
+    }
+    status_watch_stop(dev);
+    image_stream_stop(dev);
+    if (dev->finger_xfer) {
+        moc_transfer_cancel(dev->finger_xfer);
+    }
+
+    // The operation's completion handler reports MOC_ERROR_CANCELLED
+    if (dev->ssm) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_CANCELLED);
+    }
+
+    check_close_done(dev);
+}
+
+/*
+ * 0x82 reads
+ *
+ * The device answers every 0x82 read at once, so reads are never left
+ * queued while the device is idle: open and the status watch issue one
+ * read at a time. Capture keeps several reads queued only while the
+ * image streams, so back-to-back packets never wait for a resubmit.
+ * libusb completes them in submission order.
+ */
+
+static void image_cb(moc_transfer_t *xfer, void *user_data);
+
+static int image_stream_submit(moc_device_t *dev, int slot) {
+    moc_transfer_t *xfer = moc_transfer_new_bulk_in(dev->usb, MOC_EP_STATUS, MOC_EP_PACKET_SIZE);
+    return submit_tracked(dev, &dev->image_xfers[slot], xfer, 0, image_cb);
+}
+
+// Until the frame starts a single read waits for it, so the status packets
+// an always-answering device sends meanwhile are taken one at a time
+static int image_stream_fill(moc_device_t *dev) {
+    int depth = dev->image_len > 0 ? MOC_IMAGE_QUEUE_DEPTH : 1;
+    for (int i = 0; i < depth; i++) {
+        if (dev->image_xfers[i]) {
+            continue;
+        }
+        int ret = image_stream_submit(dev, i);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return MOC_SUCCESS;
+}
+
+static int image_stream_start(moc_device_t *dev) {
+    dev->streaming = 1;
+    return image_stream_fill(dev);
+}
+
+static void image_stream_stop(moc_device_t *dev) {
+    dev->streaming = 0;
+    for (int i = 0; i < MOC_IMAGE_QUEUE_DEPTH; i++) {
+        if (dev->image_xfers[i]) {
+            moc_transfer_cancel(dev->image_xfers[i]);
+        }
+    }
+}
+
+static void settle_check_stopped(moc_device_t *dev) {
+    if (dev->stopping && !dev->status_xfer && !image_reads_pending(dev)) {
+        dev->stopping = 0;
+        moc_ssm_next_state(dev->ssm);
+    }
+}
+
+static void handle_status_packet(moc_device_t *dev, const unsigned char *data, int len) {
+    if (len < 5) {
+        return;
+    }
+    uint32_t status = get_le32(data + 1);
+    if (status != dev->status) {
+        // The device repeats its status on every read; trace changes only
+        TRACE_INSTANTF("driver", "status", "0x%08X", status);
+        dev->status = status;
+    }
+}
+
+static void handle_image_packet(moc_device_t *dev, const unsigned char *data, int len) {
+    if (dev->image_complete || len < MOC_PKT_IMAGE_HEADER) {
+        return;
+    }
+
+    int seq = data[1];
+    int payload = get_le16(data + 2);
+
+    if (seq == 0) {
+        dev->image_len = 0;
+        dev->image_seq = 0;
+    } else if (dev->image_seq == 0) {
+        // Tail of a frame that started before this capture: wait for seq 0
+        return;
+    }
+    if (payload > len - MOC_PKT_IMAGE_HEADER || seq != (dev->image_seq & 0xFF)) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_PROTOCOL);
+        return;
+    }
+
+    if (payload > MOC_IMAGE_SIZE - dev->image_len) {
+        payload = MOC_IMAGE_SIZE - dev->image_len;
+    }
+    memcpy(dev->image + dev->image_len, data + MOC_PKT_IMAGE_HEADER, payload);
+    dev->image_len += payload;
+    dev->image_seq++;
+
+    if (dev->image_len < MOC_IMAGE_SIZE) {
+        return;
+    }
+
+    dev->image_complete = 1;
+    dev->timing.image_us = moc_usb_now_us(dev->usb);
+    clear_timeout(dev);
+    moc_ssm_next_state(dev->ssm);
+}
+
+static void image_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+    int slot = 0;
+
+    while (slot < MOC_IMAGE_QUEUE_DEPTH && dev->image_xfers[slot] != xfer) {
+        slot++;
+    }
+    if (slot == MOC_IMAGE_QUEUE_DEPTH) {
+        return;
+    }
+    dev->image_xfers[slot] = NULL;
+    if (dev->state == MOC_STATE_CLOSING || dev->state == MOC_STATE_CLOSED) {
+        check_close_done(dev);
+        return;
+    }
+    if (!dev->streaming) {
+        settle_check_stopped(dev);
+        return;
+    }
+
+    if (xfer->error) {
+        // Fails this capture only; the next one starts a fresh stream
+        moc_ssm_mark_failed(dev->ssm, xfer->error);
+        return;
+    }
+    if (xfer->actual_length > 0) {
+        switch (xfer->buffer[0]) {
+            case MOC_PKT_STATUS:
+                handle_status_packet(dev, xfer->buffer, xfer->actual_length);
+                break;
+            case MOC_PKT_IMAGE:
+                handle_image_packet(dev, xfer->buffer, xfer->actual_length);
+                break;
+        }
+    }
+
+    // Packet handling may have ended the capture, and its callback may
+    // have closed us
+    if (dev->state == MOC_STATE_CLOSING || dev->state == MOC_STATE_CLOSED || !dev->streaming) {
+        return;
+    }
+    int ret = image_stream_fill(dev);
+    if (ret < 0) {
+        moc_ssm_mark_failed(dev->ssm, ret);
+    }
+}
+
+/*
+ * Status watch
+ *
+ * While ready, a single 0x82 read is issued every MOC_STATUS_POLL_MS from
+ * a timer. Pacing it is what keeps a device that answers every read at
+ * once from running the loop flat out, and a failing read is retried at
+ * the same rate. The watch stops for captures and on close.
+ */
+
+static void status_poll_cb(void *user_data);
+static void watch_cb(moc_transfer_t *xfer, void *user_data);
+
+static void status_watch_start(moc_device_t *dev) {
+    dev->poll_timeout = moc_usb_add_timeout(dev->usb, MOC_STATUS_POLL_MS, status_poll_cb, dev);
+}
+
+static void status_watch_stop(moc_device_t *dev) {
+    if (dev->poll_timeout) {
+        moc_usb_remove_timeout(dev->usb, dev->poll_timeout);
+        dev->poll_timeout = NULL;
+    }
+    if (dev->status_xfer) {
+        moc_transfer_cancel(dev->status_xfer);
+    }
+}
+
+static void status_poll_cb(void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->poll_timeout = NULL;
+    moc_transfer_t *xfer = moc_transfer_new_bulk_in(dev->usb, MOC_EP_STATUS, MOC_EP_PACKET_SIZE);
+    if (submit_tracked(dev, &dev->status_xfer, xfer, MOC_STATUS_TIMEOUT_MS, watch_cb) < 0) {
+        status_watch_start(dev);
+    }
+}
+
+static void watch_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->status_xfer = NULL;
+    if (dev->state == MOC_STATE_CLOSING) {
+        check_close_done(dev);
+        return;
+    }
+    if (dev->state != MOC_STATE_READY) {
+        // Cancelled by a capture, which may be settling already
+        settle_check_stopped(dev);
+        return;
+    }
+
+    if (xfer->error && xfer->error != MOC_ERROR_TIMEOUT) {
+        TRACE_INSTANTF("driver", "status error", "%s", moc_strerror(xfer->error));
+    } else if (xfer->actual_length > 0 && xfer->buffer[0] == MOC_PKT_STATUS) {
+        handle_status_packet(dev, xfer->buffer, xfer->actual_length);
+    }
+    status_watch_start(dev);
+}
+
+/* Open */
+
+static void identity_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->ctrl_xfer = NULL;
+    if (dev->state == MOC_STATE_CLOSING) {
+        check_close_done(dev);
+        return;
+    }
+    if (xfer->error) {
+        moc_ssm_mark_failed(dev->ssm, xfer->error);
+        return;
+    }
+    if (xfer->actual_length < MOC_IDENTITY_LEN) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_PROTOCOL);
+        return;
+    }
+
+    dev->identity.vendor = get_le16(xfer->buffer);
+    dev->identity.model = get_le16(xfer->buffer + 2);
+    dev->identity.flags = get_le16(xfer->buffer + 4);
+    dev->identity.firmware = get_le16(xfer->buffer + 6);
+
+    if (dev->identity.vendor != MOC_IDENTITY_VENDOR || dev->identity.model != MOC_IDENTITY_MODEL) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_NOT_SUPPORTED);
+        return;
+    }
+    moc_ssm_next_state(dev->ssm);
+}
+
+static void properties_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->ctrl_xfer = NULL;
+    if (dev->state == MOC_STATE_CLOSING) {
+        check_close_done(dev);
+        return;
+    }
+    if (xfer->error) {
+        moc_ssm_mark_failed(dev->ssm, xfer->error);
+        return;
+    }
+    if (xfer->actual_length < 18) {
+        moc_ssm_mark_failed(dev->ssm, MOC_ERROR_PROTOCOL);
+        return;
+    }
+
+    // 0x10: name length in bytes (incl. NUL), 0x12: UTF-16LE name, e.g. "SystemWakeEnabled"
+    int end = 18 + get_le16(xfer->buffer + 16);
+    if (end > xfer->actual_length) {
+        end = xfer->actual_length;
+    }
+    size_t n = 0;
+    for (int i = 18; i + 1 < end && n + 1 < sizeof(dev->property); i += 2) {
+        uint16_t c = get_le16(xfer->buffer + i);
+        if (c == 0) {
+            break;
+        }
+        dev->property[n++] = c < 0x80 ? (char)c : '?';
+    }
+    dev->property[n] = '\0';
+
+    moc_ssm_next_state(dev->ssm);
+}
+
+static void status_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->status_xfer = NULL;
+    if (dev->state == MOC_STATE_CLOSING) {
+        check_close_done(dev);
+        return;
+    }
+    if (xfer->error) {
+        moc_ssm_mark_failed(dev->ssm, xfer->error);
+        return;
+    }
+    if (xfer->actual_length < 1 || xfer->buffer[0] != MOC_PKT_STATUS) {
+        // Image packets left over from an aborted capture: read on
+        moc_ssm_jump_to_state(dev->ssm, OPEN_READ_STATUS);
+        return;
+    }
+
+    handle_status_packet(dev, xfer->buffer, xfer->actual_length);
+    moc_ssm_next_state(dev->ssm);
+}
+
+static void open_run_state(moc_ssm_t *ssm, void *user_data) {
+    moc_device_t *dev = user_data;
+    moc_transfer_t *xfer;
+    int ret;
+
+    switch (moc_ssm_get_cur_state(ssm)) {
+        case OPEN_GET_IDENTITY:
+            xfer = moc_transfer_new_control_in(dev->usb, MOC_REQ_IDENTITY, 0, 0, MOC_IDENTITY_LEN);
+            ret = submit_tracked(dev, &dev->ctrl_xfer, xfer, MOC_CONTROL_TIMEOUT_MS, identity_cb);
+            if (ret < 0) {
+                moc_ssm_mark_failed(ssm, ret);
+            }
+            break;
+
+        case OPEN_GET_PROPERTIES:
+            xfer = moc_transfer_new_control_in(dev->usb, MOC_REQ_PROPERTIES, 0, 0, MOC_PROPERTIES_LEN);
+            ret = submit_tracked(dev, &dev->ctrl_xfer, xfer, MOC_CONTROL_TIMEOUT_MS, properties_cb);
+            if (ret < 0) {
+                moc_ssm_mark_failed(ssm, ret);
+            }
+            break;
+
+        case OPEN_READ_STATUS:
+            // Answered at once on hardware; the timeout covers a silent device
+            xfer = moc_transfer_new_bulk_in(dev->usb, MOC_EP_STATUS, MOC_EP_PACKET_SIZE);
+            ret = submit_tracked(dev, &dev->status_xfer, xfer, MOC_STATUS_TIMEOUT_MS, status_cb);
+            if (ret < 0) {
+                moc_ssm_mark_failed(ssm, ret);
+            }
+            break;
+    }
+}
+
+static void open_failed_closed(moc_device_t *dev, int error, void *user_data) {
+    (void)error;
+    (void)user_data;
+    report(dev, dev->open_error);
+}
+
+static void open_done(moc_ssm_t *ssm, void *user_data, int error) {
+    moc_device_t *dev = user_data;
+    (void)ssm;
+
+    dev->ssm = NULL;
+    clear_timeout(dev);
+
+    if (dev->state == MOC_STATE_CLOSING) {
+        report(dev, error);
+        return;
+    }
+    if (error) {
+        // Drain whatever is still in flight before telling the caller
+        dev->open_error = error;
+        begin_close(dev, open_failed_closed, NULL);
+        return;
+    }
+
+    dev->state = MOC_STATE_READY;
+    status_watch_start(dev);
+    dev->timing.ready_us = moc_usb_now_us(dev->usb);
+    report(dev, MOC_SUCCESS);
+}
+
+/* Capture */
+
+static void finger_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->finger_xfer = NULL;
+    if (dev->state == MOC_STATE_CLOSING) {
+        check_close_done(dev);
+        return;
+    }
+    if (!dev->ssm) {
+        return;
+    }
+    if (xfer->error) {
+        moc_ssm_mark_failed(dev->ssm, xfer->error);
+        return;
+    }
+
+    if (xfer->actual_length < 1 || xfer->buffer[0] != MOC_FINGER_ON) {
+        // Finger-off or noise: re-arm and keep waiting
+        moc_ssm_jump_to_state(dev->ssm, CAPTURE_ARM_FINGER);
+        return;
+    }
+
+    dev->timing.touch_us = moc_usb_now_us(dev->usb);
+    dev->state = MOC_STATE_CAPTURING;
+    TRACE_INSTANT("driver", "finger on");
+    moc_ssm_next_state(dev->ssm);
+}
+
+static void capture_run_state(moc_ssm_t *ssm, void *user_data) {
+    moc_device_t *dev = user_data;
+    moc_transfer_t *xfer;
+    int ret;
+
+    switch (moc_ssm_get_cur_state(ssm)) {
+        case CAPTURE_ARM_FINGER:
+            dev->state = MOC_STATE_AWAIT_FINGER;
+            dev->image_len = 0;
+            dev->image_seq = 0;
+            dev->image_complete = 0;
+
+            xfer = moc_transfer_new_interrupt_in(dev->usb, MOC_EP_FINGER, MOC_INT_PACKET_SIZE);
+            ret = submit_tracked(dev, &dev->finger_xfer, xfer, 0, finger_cb);
+            if (ret < 0) {
+                moc_ssm_mark_failed(ssm, ret);
+            }
+            break;
+
+        case CAPTURE_READ_IMAGE:
+            ret = image_stream_start(dev);
+            if (ret < 0) {
+                moc_ssm_mark_failed(ssm, ret);
+            } else {
+                ssm_wait(dev, MOC_CAPTURE_TIMEOUT_MS);
+            }
+            break;
+    }
+}
+
+static void drain_cb(moc_transfer_t *xfer, void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->status_xfer = NULL;
+    if (dev->state == MOC_STATE_CLOSING) {
+        check_close_done(dev);
+        return;
+    }
+    if (xfer->error && xfer->error != MOC_ERROR_TIMEOUT) {
+        moc_ssm_mark_failed(dev->ssm, xfer->error);
+        return;
+    }
+    if (!xfer->error && (xfer->actual_length < 1 || xfer->buffer[0] != MOC_PKT_STATUS)) {
+        moc_ssm_jump_to_state(dev->ssm, SETTLE_DRAIN);
+        return;
+    }
+    if (!xfer->error) {
+        handle_status_packet(dev, xfer->buffer, xfer->actual_length);
+    }
+
+    // Status (or nothing) now only means the queue is empty for the moment;
+    // the sensor may still be producing the failed frame
+    uint64_t frame_done_us = dev->timing.touch_us + (uint64_t)MOC_CAPTURE_TIMEOUT_MS * 1000;
+    if (moc_usb_now_us(dev->usb) >= frame_done_us) {
+        moc_ssm_mark_completed(dev->ssm);
+    } else {
+        moc_ssm_jump_to_state(dev->ssm, SETTLE_PAUSE);
+    }
+}
+
+static void settle_pause_cb(void *user_data) {
+    moc_device_t *dev = user_data;
+
+    dev->timeout = NULL;
+    moc_ssm_jump_to_state(dev->ssm, SETTLE_DRAIN);
+}
+
+static void settle_run_state(moc_ssm_t *ssm, void *user_data) {
+    moc_device_t *dev = user_data;
+    moc_transfer_t *xfer;
+    int ret;
+
+    switch (moc_ssm_get_cur_state(ssm)) {
+        case SETTLE_STOP_STREAM:
+            image_stream_stop(dev);
+            dev->stopping = 1;
+            settle_check_stopped(dev);
+            break;
+
+        case SETTLE_DRAIN:
+            if (dev->capture_error == MOC_SUCCESS) {
+                moc_ssm_mark_completed(ssm);
+                break;
+            }
+            // The rest of a failed frame would be read first by the next capture
+            xfer = moc_transfer_new_bulk_in(dev->usb, MOC_EP_STATUS, MOC_EP_PACKET_SIZE);
+            ret = submit_tracked(dev, &dev->status_xfer, xfer, MOC_STATUS_TIMEOUT_MS, drain_cb);
+            if (ret < 0) {
+                moc_ssm_mark_failed(ssm, ret);
+            }
+            break;
+
+        case SETTLE_PAUSE:
+            // Paced like the status watch, so an always-answering device is not spun on
+            dev->timeout = moc_usb_add_timeout(dev->usb, MOC_STATUS_POLL_MS, settle_pause_cb, dev);
+            if (!dev->timeout) {
+                moc_ssm_mark_failed(ssm, MOC_ERROR_NO_MEM);
+            }
+            break;
+    }
+}
+
+static void settle_done(moc_ssm_t *ssm, void *user_data, int error) {
+    moc_device_t *dev = user_data;
+    (void)ssm;
+
+    dev->ssm = NULL;
+    dev->stopping = 0;
+    clear_timeout(dev);
+
+    if (dev->state != MOC_STATE_CLOSING) {
+        dev->state = MOC_STATE_READY;
+        status_watch_start(dev);
+        if (dev->capture_error) {
+            error = dev->capture_error;
+        }
+    }
+    report(dev, error);
+}
+
+static void capture_done(moc_ssm_t *ssm, void *user_data, int error) {
+    moc_device_t *dev = user_data;
+    (void)ssm;
+
+    dev->ssm = NULL;
+    clear_timeout(dev);
+
+    if (dev->state == MOC_STATE_CLOSING) {
+        report(dev, error);
+        return;
+    }
+    if (dev->finger_xfer) {
+        moc_transfer_cancel(dev->finger_xfer);
+    }
+    if (dev->state != MOC_STATE_CAPTURING) {
+        // No finger yet, so nothing was read from 0x82
+        dev->state = MOC_STATE_READY;
+        status_watch_start(dev);
+        report(dev, error);
+        return;
+    }
+
+    dev->capture_error = error;
+    dev->ssm = moc_ssm_new(dev, settle_run_state, SETTLE_NUM_STATES, "settle");
+    if (!dev->ssm) {
+        image_stream_stop(dev);
+        dev->state = MOC_STATE_READY;
+        status_watch_start(dev);
+        report(dev, error ? error : MOC_ERROR_NO_MEM);
+        return;
+    }
+    moc_ssm_start(dev->ssm, settle_done);
+}
+
+/* Public API */
+
+moc_device_t *moc_device_new(moc_usb_t *usb) {
+    moc_device_t *dev = calloc(1, sizeof(*dev));
+    if (dev) {
+        dev->usb = usb;
+        dev->state = MOC_STATE_CLOSED;
+    }
+    return dev;
+}
+
+void moc_device_free(moc_device_t *dev) {
+    free(dev);
+}
+
+int moc_device_open(moc_device_t *dev, moc_done_cb callback, void *user_data) {
+    if (dev->state != MOC_STATE_CLOSED || transfers_in_flight(dev)) {
+        return MOC_ERROR_BUSY;
+    }
+
+    moc_ssm_t *ssm = moc_ssm_new(dev, open_run_state, OPEN_NUM_STATES, "open");
+    if (!ssm) {
+        return MOC_ERROR_NO_MEM;
+    }
+
+    memset(&dev->identity, 0, sizeof(dev->identity));
+    memset(&dev->timing, 0, sizeof(dev->timing));
+    dev->property[0] = '\0';
+    dev->status = 0;
+    dev->open_error = MOC_SUCCESS;
+    dev->timing.open_start_us = moc_usb_now_us(dev->usb);
+
+    dev->state = MOC_STATE_OPENING;
+    dev->callback = callback;
+    dev->user_data = user_data;
+    dev->ssm = ssm;
+    moc_ssm_start(ssm, open_done);
+    return MOC_SUCCESS;
+}
+
+int moc_device_capture(moc_device_t *dev, moc_done_cb callback, void *user_data) {
+    if (dev->state != MOC_STATE_READY || dev->finger_xfer || image_reads_pending(dev)) {
+        return MOC_ERROR_BUSY;
+    }
+
+    moc_ssm_t *ssm = moc_ssm_new(dev, capture_run_state, CAPTURE_NUM_STATES, "capture");
+    if (!ssm) {
+        return MOC_ERROR_NO_MEM;
+    }
+    status_watch_stop(dev);
+
+    dev->timing.touch_us = 0;
+    dev->timing.image_us = 0;
+    dev->callback = callback;
+    dev->user_data = user_data;
+    dev->ssm = ssm;
+    moc_ssm_start(ssm, capture_done);
+    return MOC_SUCCESS;
+}
+
+int moc_device_close(moc_device_t *dev, moc_done_cb callback, void *user_data) {
+    if (dev->state == MOC_STATE_CLOSING) {
+        return MOC_ERROR_BUSY;
+    }
+    if (dev->state == MOC_STATE_CLOSED && !transfers_in_flight(dev)) {
+        if (callback) {
+            callback(dev, MOC_SUCCESS, user_data);
+        }
+        return MOC_SUCCESS;
+    }
+
+    begin_close(dev, callback, user_data);
+    return MOC_SUCCESS;
+}
+
+moc_state_t moc_device_get_state(const moc_device_t *dev) {
+    return dev->state;
+}
+
+const moc_identity_t *moc_device_get_identity(const moc_device_t *dev) {
+    return &dev->identity;
+}
+
+const char *moc_device_get_property(const moc_device_t *dev) {
+    return dev->property;
+}
+
+uint32_t moc_device_get_status(const moc_device_t *dev) {
+    return dev->status;
+}
+
+const unsigned char *moc_device_get_image(const moc_device_t *dev) {
+    return dev->image_complete ? dev->image : NULL;
+}
+
+const moc_timing_t *moc_device_get_timing(const moc_device_t *dev) {
+    return &dev->timing;
+}
@@ -0,0 +1,110 @@
+/*
+ * Realtek/Microctopus MoC Driver Core
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Standalone, fully asynchronous driver core built on the control-transfer
+ * protocol documented in docs/protocol-findings.md. Every operation is an
+ * SSM (see moc_ssm.h) driven from moc_usb_handle_events(); no call blocks
+ * or sleeps.
+ *
+ *   open:    0x06 identity -> 0x15 properties -> one 0x82 status read -> ready
+ *   ready:   paced status watch, one 0x82 read per MOC_STATUS_POLL_MS
+ *   capture: arm 0x83 finger interrupt -> queue 0x82 reads, assemble image
+ *            -> settle: drain the reads, discard a failed frame's leftovers
+ *   close:   cancel in-flight transfers, report once they have drained
+ *
+ * Observed on hardware: requests 0x06/0x15, the 0x82 status packet.
+ * Hypothesis (marked below): finger interrupt format and image framing.
+ * These are isolated here so they can be corrected once captured.
+ */
+
+#ifndef REALTEK_MOC_H
+#define REALTEK_MOC_H
+
+#include <stdint.h>
+
+#include "moc_usb.h"
+
+#define MOC_VID 0x2541
+#define MOC_PID 0xfa03
+
+#define MOC_EP_STATUS 0x82      // Bulk IN: status and image packets
+#define MOC_EP_FINGER 0x83      // Interrupt IN: finger events
+#define MOC_EP_PACKET_SIZE 512
+#define MOC_INT_PACKET_SIZE 16
+#define MOC_IMAGE_QUEUE_DEPTH 4 // Bulk reads kept queued on 0x82 while capturing
+
+// Vendor control requests (IN, bmRequestType 0xC0)
+#define MOC_REQ_IDENTITY 0x06   // wValue 0: 8-byte identity
+#define MOC_REQ_PROPERTIES 0x15 // 64-byte property record
+
+#define MOC_IDENTITY_LEN 8
+#define MOC_PROPERTIES_LEN 64
+
+// Identity prefix seen on hardware: DA 0B 13 58 00 00 32 00
+#define MOC_IDENTITY_VENDOR 0x0BDA
+#define MOC_IDENTITY_MODEL 0x5813
+
+// 0x82 packet types; byte 0 of every packet
+#define MOC_PKT_STATUS 0x01     // 01 F7 FF FF FF seen on hardware
+#define MOC_PKT_IMAGE 0x02      // Hypothesis: 02 <seq> <len lo> <len hi> <pixels>
+#define MOC_PKT_IMAGE_HEADER 4
+
+// Hypothesis: byte 0 of an 0x83 interrupt packet
+#define MOC_FINGER_OFF 0x00
+#define MOC_FINGER_ON 0x01
+
+// Hypothesis: 8-bit greyscale frame size
+#define MOC_IMAGE_WIDTH 160
+#define MOC_IMAGE_HEIGHT 160
+#define MOC_IMAGE_SIZE (MOC_IMAGE_WIDTH * MOC_IMAGE_HEIGHT)
+
+#define MOC_CONTROL_TIMEOUT_MS 1000
+#define MOC_STATUS_TIMEOUT_MS 500   // Any single status read on 0x82
+#define MOC_STATUS_POLL_MS 200      // Status read interval while ready
+#define MOC_CAPTURE_TIMEOUT_MS 2000 // Finger-on to last image packet
+
+typedef enum {
+    MOC_STATE_CLOSED,
+    MOC_STATE_OPENING,
+    MOC_STATE_READY,
+    MOC_STATE_AWAIT_FINGER,
+    MOC_STATE_CAPTURING,
+    MOC_STATE_CLOSING,
+} moc_state_t;
+
+typedef struct moc_device moc_device_t;
+
+typedef void (*moc_done_cb)(moc_device_t *dev, int error, void *user_data);
+
+typedef struct {
+    uint16_t vendor;
+    uint16_t model;
+    uint16_t flags;
+    uint16_t firmware;
+} moc_identity_t;
+
+typedef struct {
+    // Virtual or monotonic microseconds, depending on the USB backend
+    uint64_t open_start_us;
+    uint64_t ready_us;
+    uint64_t touch_us;
+    uint64_t image_us;
+} moc_timing_t;
+
+moc_device_t *moc_device_new(moc_usb_t *usb);
+void moc_device_free(moc_device_t *dev);
+
+int moc_device_open(moc_device_t *dev, moc_done_cb callback, void *user_data);
+int moc_device_capture(moc_device_t *dev, moc_done_cb callback, void *user_data);
+int moc_device_close(moc_device_t *dev, moc_done_cb callback, void *user_data);
+
+moc_state_t moc_device_get_state(const moc_device_t *dev);
+const moc_identity_t *moc_device_get_identity(const moc_device_t *dev);
+const char *moc_device_get_property(const moc_device_t *dev);
+uint32_t moc_device_get_status(const moc_device_t *dev);
+const unsigned char *moc_device_get_image(const moc_device_t *dev);
+const moc_timing_t *moc_device_get_timing(const moc_device_t *dev);
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * Driver Core Simulation Runner
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Runs the driver core against the simulated device (moc_usb_sim.c)
+ * through open, capture, fault and cancellation scenarios, and checks
+ * open-to-ready / touch-to-image against the simulated device's own
+ * timings on the virtual clock. These are regression budgets for the
+ * driver's transfer scheduling, not hardware latencies. Needs no hardware
+ * and no root.
+ *
+ * Build: make moc_sim
+ * Run: ./moc_sim
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "moc_usb_sim.h"
+#include "realtek_moc.h"
+
+#define IMAGE_CHUNK (MOC_EP_PACKET_SIZE - MOC_PKT_IMAGE_HEADER)
+#define IMAGE_CHUNKS ((MOC_IMAGE_SIZE + IMAGE_CHUNK - 1) / IMAGE_CHUNK)
+
+typedef struct {
+    int done;
+    int error;
+} op_result_t;
+
+typedef struct {
+    moc_usb_t *usb;
+    moc_device_t *dev;
+    moc_sim_config_t config;
+} sim_env_t;
+
+static void op_cb(moc_device_t *dev, int error, void *user_data) {
+    op_result_t *result = user_data;
+    (void)dev;
+    result->done = 1;
+    result->error = error;
+}
+
+// Drive the loop until the operation reports; only the loop ever waits
+static int run_until_done(moc_usb_t *usb, op_result_t *result) {
+    while (!result->done) {
+        if (moc_usb_handle_events(usb, -1) == MOC_ERROR_IDLE) {
+            printf("FAIL: event loop went idle before the operation finished\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int expect_error(const char *what, int got, int want) {
+    if (got != want) {
+        printf("FAIL: %s: got %s (%d), expected %s (%d)\n", what,
+               moc_strerror(got), got, moc_strerror(want), want);
+        return -1;
+    }
+    return 0;
+}
+
+static int env_setup(sim_env_t *env) {
+    env->usb = moc_usb_sim_new(&env->config);
+    env->dev = env->usb ? moc_device_new(env->usb) : NULL;
+    if (!env->dev) {
+        printf("FAIL: out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int env_open(sim_env_t *env, int want) {
+    op_result_t result = { 0 };
+    int ret = moc_device_open(env->dev, op_cb, &result);
+    if (expect_error("open submit", ret, MOC_SUCCESS) || run_until_done(env->usb, &result)) {
+        return -1;
+    }
+    return expect_error("open", result.error, want);
+}
+
+static int env_capture(sim_env_t *env, unsigned int touch_after_ms, int want) {
+    op_result_t result = { 0 };
+    moc_usb_sim_touch(env->usb, touch_after_ms);
+    int ret = moc_device_capture(env->dev, op_cb, &result);
+    if (expect_error("capture submit", ret, MOC_SUCCESS) || run_until_done(env->usb, &result)) {
+        return -1;
+    }
+    return expect_error("capture", result.error, want);
+}
+
+// Close, then make sure nothing is left in flight
+static int env_teardown(sim_env_t *env) {
+    op_result_t result = { 0 };
+    int ret = 0;
+
+    if (moc_device_close(env->dev, op_cb, &result) < 0 || run_until_done(env->usb, &result)) {
+        ret = -1;
+    } else if (moc_device_get_state(env->dev) != MOC_STATE_CLOSED) {
+        printf("FAIL: device not closed after close\n");
+        ret = -1;
+    } else if (env->usb->in_flight != 0 || env->usb->timeouts) {
+        printf("FAIL: %d transfers / timers left after close\n", env->usb->in_flight);
+        ret = -1;
+    }
+
+    moc_device_free(env->dev);
+    moc_usb_free(env->usb);
+    return ret;
+}
+
+// While ready the status watch reads 0x82 once per poll interval: on a
+// device that answers every read at once, anything faster spins the loop
+static int expect_paced(sim_env_t *env) {
+    const unsigned int window_ms = 1000;
+    const unsigned int limit = window_ms / MOC_STATUS_POLL_MS + 1;
+    unsigned int reads = moc_usb_sim_status_reads(env->usb);
+    uint64_t end = moc_usb_now_us(env->usb) + (uint64_t)window_ms * 1000;
+
+    for (uint64_t now; (now = moc_usb_now_us(env->usb)) < end;) {
+        if (env->usb->in_flight > 1) {
+            printf("FAIL: %d transfers in flight while ready\n", env->usb->in_flight);
+            return -1;
+        }
+        moc_usb_handle_events(env->usb, (int)((end - now + 999) / 1000));
+    }
+
+    reads = moc_usb_sim_status_reads(env->usb) - reads;
+    printf("Status reads while ready: %u in %u ms (limit %u)\n", reads, window_ms, limit);
+    if (reads == 0 || reads > limit || moc_device_get_state(env->dev) != MOC_STATE_READY) {
+        printf("FAIL: status watch not paced\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int check_image(const moc_device_t *dev) {
+    const unsigned char *image = moc_device_get_image(dev);
+    if (!image) {
+        printf("FAIL: no image after capture\n");
+        return -1;
+    }
+    for (int y = 0; y < MOC_IMAGE_HEIGHT; y++) {
+        for (int x = 0; x < MOC_IMAGE_WIDTH; x++) {
+            if (image[y * MOC_IMAGE_WIDTH + x] != moc_usb_sim_pixel(x, y)) {
+                printf("FAIL: pixel mismatch at (%d, %d)\n", x, y);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// The frame must come from this touch, not from packets a failed capture
+// left queued on 0x82
+static int check_fresh_image(const sim_env_t *env) {
+    const moc_timing_t *timing = moc_device_get_timing(env->dev);
+    if (check_image(env->dev)) {
+        return -1;
+    }
+    if (timing->image_us - timing->touch_us < env->config.capture_us) {
+        printf("FAIL: image %llu us after touch, sensor needs %u us\n",
+               (unsigned long long)(timing->image_us - timing->touch_us), env->config.capture_us);
+        return -1;
+    }
+    return 0;
+}
+
+static int scenario_open_capture(int status_always) {
+    sim_env_t env;
+    moc_sim_config_init(&env.config);
+    env.config.status_always = status_always;
+    if (env_setup(&env) || env_open(&env, MOC_SUCCESS) || expect_paced(&env)) {
+        return -1;
+    }
+
+    const moc_identity_t *id = moc_device_get_identity(env.dev);
+    printf("Identity: vendor 0x%04X, model 0x%04X, firmware 0x%04X\n",
+           id->vendor, id->model, id->firmware);
+    printf("Property: %s\n", moc_device_get_property(env.dev));
+    printf("Status: 0x%08X\n", moc_device_get_status(env.dev));
+
+    if (id->firmware != 0x0032 || strcmp(moc_device_get_property(env.dev), "SystemWakeEnabled") != 0 ||
+        moc_device_get_status(env.dev) != 0xFFFFFFF7) {
+        printf("FAIL: open did not decode the device responses\n");
+        return -1;
+    }
+
+    // Two round trips on control + one 0x82 read, nothing else
+    const moc_timing_t *timing = moc_device_get_timing(env.dev);
+    uint64_t open_us = timing->ready_us - timing->open_start_us;
+    uint64_t open_budget = 2 * env.config.control_latency_us + env.config.packet_latency_us;
+    printf("Open-to-ready: %llu us (budget %llu us)\n",
+           (unsigned long long)open_us, (unsigned long long)open_budget);
+    if (open_us > open_budget) {
+        printf("FAIL: open-to-ready over budget\n");
+        return -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (env_capture(&env, 200, MOC_SUCCESS) || check_image(env.dev) || expect_paced(&env)) {
+            return -1;
+        }
+
+        // Sensor time only: capture delay plus streaming the chunks
+        uint64_t image_us = timing->image_us - timing->touch_us;
+        uint64_t image_budget = env.config.capture_us + IMAGE_CHUNKS * env.config.chunk_us;
+        printf("Capture %d touch-to-image: %llu us (budget %llu us)\n", i + 1,
+               (unsigned long long)image_us, (unsigned long long)image_budget);
+        if (image_us > image_budget) {
+            printf("FAIL: touch-to-image over budget\n");
+            return -1;
+        }
+    }
+
+    return env_teardown(&env);
+}
+
+static int scenario_open_fault(const char *fault, int want) {
+    sim_env_t env;
+    moc_sim_config_init(&env.config);
+    env.config.bad_identity = strcmp(fault, "bad_identity") == 0;
+    env.config.stall_properties = strcmp(fault, "stall_properties") == 0;
+    env.config.silent_status = strcmp(fault, "silent_status") == 0;
+
+    if (env_setup(&env) || env_open(&env, want)) {
+        return -1;
+    }
+    return env_teardown(&env);
+}
+
+static int scenario_capture_fault(const char *fault, int want) {
+    sim_env_t env;
+    moc_sim_config_init(&env.config);
+    env.config.truncate_image = strcmp(fault, "truncate_image") == 0;
+    env.config.corrupt_image = strcmp(fault, "corrupt_image") == 0;
+
+    if (env_setup(&env) || env_open(&env, MOC_SUCCESS) || env_capture(&env, 100, want)) {
+        return -1;
+    }
+    if (moc_device_get_state(env.dev) != MOC_STATE_READY) {
+        printf("FAIL: device not ready again after failed capture\n");
+        return -1;
+    }
+
+    // The next touch streams cleanly and must not be mixed with the old frame
+    env.config.truncate_image = 0;
+    env.config.corrupt_image = 0;
+    moc_usb_sim_configure(env.usb, &env.config);
+    if (env_capture(&env, 100, MOC_SUCCESS) || check_fresh_image(&env)) {
+        return -1;
+    }
+    return env_teardown(&env);
+}
+
+// Failed 0x82 reads: the status watch retries at its own pace, a capture
+// fails, and the next capture recovers
+static int scenario_read_error(void) {
+    sim_env_t env;
+    moc_sim_config_init(&env.config);
+    env.config.status_always = 1;
+
+    if (env_setup(&env) || env_open(&env, MOC_SUCCESS)) {
+        return -1;
+    }
+    moc_usb_sim_fail_status_reads(env.usb, 2);
+    if (expect_paced(&env)) {
+        return -1;
+    }
+    moc_usb_sim_fail_status_reads(env.usb, 1);
+    if (env_capture(&env, 100, MOC_ERROR_IO)) {
+        return -1;
+    }
+    if (moc_device_get_state(env.dev) != MOC_STATE_READY) {
+        printf("FAIL: device not ready again after failed read\n");
+        return -1;
+    }
+    if (env_capture(&env, 100, MOC_SUCCESS) || check_fresh_image(&env)) {
+        return -1;
+    }
+    return env_teardown(&env);
+}
+
+static int scenario_close_while_waiting(void) {
+    sim_env_t env;
+    op_result_t capture = { 0 };
+    moc_sim_config_init(&env.config);
+
+    if (env_setup(&env) || env_open(&env, MOC_SUCCESS)) {
+        return -1;
+    }
+
+    // No touch scheduled: the finger interrupt stays armed until close
+    if (expect_error("capture submit", moc_device_capture(env.dev, op_cb, &capture), MOC_SUCCESS)) {
+        return -1;
+    }
+    moc_usb_handle_events(env.usb, 500);
+    if (capture.done || moc_device_get_state(env.dev) != MOC_STATE_AWAIT_FINGER) {
+        printf("FAIL: capture did not wait for a finger\n");
+        return -1;
+    }
+
+    if (env_teardown(&env)) {
+        return -1;
+    }
+    return expect_error("capture", capture.error, MOC_ERROR_CANCELLED);
+}
+
+int main(void) {
+    struct {
+        const char *name;
+        int result;
+    } results[16];
+    int n = 0;
+
+    printf("Driver Core Simulation for Realtek 2541:fa03\n");
+    printf("============================================\n");
+
+#define RUN(label, call) do {                               \
+        printf("\n=== Scenario: %s ===\n", label);          \
+        results[n].name = label;                            \
+        results[n].result = (call);                         \
+        printf("%s\n", results[n].result ? "✗ FAIL" : "✓ PASS"); \
+        n++;                                                \
+    } while (0)
+
+    RUN("Open and capture", scenario_open_capture(0));
+    RUN("Open and capture, 0x82 always answers", scenario_open_capture(1));
+    RUN("Wrong identity", scenario_open_fault("bad_identity", MOC_ERROR_NOT_SUPPORTED));
+    RUN("Property request stalls", scenario_open_fault("stall_properties", MOC_ERROR_PIPE));
+    RUN("No status on 0x82", scenario_open_fault("silent_status", MOC_ERROR_TIMEOUT));
+    RUN("Image stream truncated", scenario_capture_fault("truncate_image", MOC_ERROR_TIMEOUT));
+    RUN("Image sequence gap", scenario_capture_fault("corrupt_image", MOC_ERROR_PROTOCOL));
+    RUN("0x82 read error during capture", scenario_read_error());
+    RUN("Close while waiting for finger", scenario_close_while_waiting());
+
+#undef RUN
+
+    int failures = 0;
+    printf("\n=== Summary ===\n");
+    for (int i = 0; i < n; i++) {
+        printf("%s %s\n", results[i].result ? "✗" : "✓", results[i].name);
+        failures += results[i].result != 0;
+    }
+    printf("Passed: %d/%d\n", n - failures, n);
+
+    return failures ? 1 : 0;
+}
@@ -10,6 +10,8 @@
  *
  * Build: gcc probe.c -o probe -lusb-1.0
  * Run: sudo ./probe
+ *
+ * Timing: build with `make TRACE=1` to record spans into trace.json.
  */
 
 #include <libusb-1.0/libusb.h>
@@ -18,6 +20,8 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "trace.h"
+
 #define VID 0x2541
 #define PID 0xfa03
 #define EP_OUT 0x01
@@ -69,7 +73,10 @@ int try_send_receive(libusb_device_handle *handle, uint8_t *cmd, int cmd_len,
     print_hex("Sending", cmd, cmd_len);
 
     // Send command
+    uint64_t start = TRACE_NOW();
     ret = libusb_bulk_transfer(handle, EP_OUT, cmd, cmd_len, &transferred, TIMEOUT_MS);
+    TRACE_COMPLETEF("transfer", "bulk_out", start, "ep=0x%02X %s, %d/%d bytes",
+                    EP_OUT, libusb_error_name(ret), transferred, cmd_len);
     if (ret != 0) {
         print_error("Send", ret);
         return -1;
@@ -80,7 +87,10 @@ int try_send_receive(libusb_device_handle *handle, uint8_t *cmd, int cmd_len,
     unsigned char response[8192];
     memset(response, 0, sizeof(response));
 
+    start = TRACE_NOW();
     ret = libusb_bulk_transfer(handle, ep_in, response, sizeof(response), &transferred, TIMEOUT_MS);
+    TRACE_COMPLETEF("transfer", "bulk_in", start, "ep=0x%02X %s, %d bytes",
+                    ep_in, libusb_error_name(ret), transferred);
     if (ret != 0) {
         print_error("Receive", ret);
         return -1;
@@ -150,6 +160,7 @@ int main(int argc, char *argv[]) {
     int num_tests = sizeof(test_commands) / sizeof(test_commands[0]);
     int successes = 0;
 
+    TRACE_BEGIN("phase", "Command Tests");
     for (int i = 0; i < num_tests; i++) {
         int cmd_len = 8;
 
@@ -158,14 +169,19 @@ int main(int argc, char *argv[]) {
             cmd_len = 3;
         }
 
+        TRACE_BEGINF("request", "try_send_receive", "%s", test_commands[i].name);
         if (try_send_receive(handle, test_commands[i].cmd, cmd_len,
                             EP_IN_BULK, test_commands[i].name) == 0) {
             successes++;
             printf("✓ SUCCESS!\n");
         }
+        TRACE_END();
 
+        TRACE_BEGIN("sleep", "usleep");
         usleep(500000); // Wait 500ms between tests
+        TRACE_END();
     }
+    TRACE_END();
 
     printf("\n=== Summary ===\n");
     printf("Total tests: %d\n", num_tests);
@@ -11,6 +11,8 @@
  *
  * Build: gcc probe_advanced.c -o probe_advanced -lusb-1.0
  * Run: sudo ./probe_advanced
+ *
+ * Timing: build with `make TRACE=1` to record spans into trace.json.
  */
 
 #include <libusb-1.0/libusb.h>
@@ -19,6 +21,8 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "trace.h"
+
 #define VID 0x2541
 #define PID 0xfa03
 
@@ -121,8 +125,12 @@ int test_control_transfer(libusb_device_handle *handle, const char *name,
     printf("wIndex: 0x%04X\n", wIndex);
     printf("wLength: %d\n", wLength);
 
+    uint64_t start = TRACE_NOW();
     int ret = libusb_control_transfer(handle, bmRequestType, bRequest,
                                       wValue, wIndex, data, wLength, 1000);
+    TRACE_COMPLETEF("transfer", "control", start, "type=0x%02X req=0x%02X value=0x%04X %s, %d bytes",
+                    bmRequestType, bRequest, wValue,
+                    libusb_error_name(ret < 0 ? ret : 0), ret < 0 ? 0 : ret);
 
     if (ret < 0) {
         printf("ERROR: %s (%d)\n", libusb_error_name(ret), ret);
@@ -140,12 +148,15 @@ int test_control_transfer(libusb_device_handle *handle, const char *name,
 
 int test_interrupt_endpoint(libusb_device_handle *handle, uint8_t endpoint, const char *name) {
     unsigned char data[256];
-    int transferred;
+    int transferred = 0;
 
     printf("\n=== Interrupt Endpoint %s (0x%02X) ===\n", name, endpoint);
 
+    uint64_t start = TRACE_NOW();
     int ret = libusb_interrupt_transfer(handle, endpoint, data, sizeof(data),
                                        &transferred, 1000);
+    TRACE_COMPLETEF("transfer", "interrupt_in", start, "ep=0x%02X %s, %d bytes",
+                    endpoint, libusb_error_name(ret), transferred);
 
     if (ret < 0) {
         printf("ERROR: %s (%d)\n", libusb_error_name(ret), ret);
@@ -190,6 +201,7 @@ int main(void) {
     printf("Device %04X:%04X opened successfully\n\n", VID, PID);
 
     // Dump descriptors
+    TRACE_BEGIN("phase", "Descriptors");
     dump_device_descriptor(dev);
     dump_config_descriptor(dev);
 
@@ -220,6 +232,8 @@ int main(void) {
         }
     }
 
+    TRACE_END();
+
     // Detach kernel driver
     if (libusb_kernel_driver_active(handle, 0) == 1) {
         printf("\nDetaching kernel driver...\n");
@@ -236,6 +250,7 @@ int main(void) {
     }
 
     printf("\n=== Testing USB Communication ===\n");
+    TRACE_BEGIN("phase", "Standard Requests");
 
     // Test standard USB control requests
     test_control_transfer(handle, "Get Status",
@@ -246,29 +261,42 @@ int main(void) {
                          LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_DEVICE,
                          LIBUSB_REQUEST_GET_DESCRIPTOR, 0x0100, 0, 18);
 
+    TRACE_END();
+
     // Test vendor-specific control requests
     printf("\n=== Vendor-Specific Control Transfers ===\n");
+    TRACE_BEGIN("phase", "Vendor Requests");
     for (int i = 0; i < 16; i++) {
         char name[32];
         snprintf(name, sizeof(name), "Vendor Request 0x%02X", i);
         test_control_transfer(handle, name,
                              LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
                              i, 0, 0, 64);
+        TRACE_BEGIN("sleep", "usleep");
         usleep(100000); // 100ms delay
+        TRACE_END();
     }
+    TRACE_END();
 
     // Test interrupt endpoints
     printf("\n=== Testing Interrupt Endpoints ===\n");
+    TRACE_BEGIN("phase", "Interrupt Endpoints");
     test_interrupt_endpoint(handle, 0x83, "INT1");
     test_interrupt_endpoint(handle, 0x84, "INT2");
+    TRACE_END();
 
     // Try reading without sending first
     printf("\n=== Trying Spontaneous Reads ===\n");
     unsigned char buffer[8192];
-    int transferred;
+    int transferred = 0;
 
     printf("Trying to read from bulk endpoint 0x82...\n");
+    TRACE_BEGIN("phase", "Spontaneous Reads");
+    uint64_t start = TRACE_NOW();
     ret = libusb_bulk_transfer(handle, 0x82, buffer, sizeof(buffer), &transferred, 1000);
+    TRACE_COMPLETEF("transfer", "bulk_in", start, "ep=0x82 %s, %d bytes",
+                    libusb_error_name(ret), transferred);
+    TRACE_END();
     if (ret == 0 && transferred > 0) {
         printf("Received %d bytes spontaneously!\n", transferred);
         print_hex("Data", buffer, transferred > 64 ? 64 : transferred);
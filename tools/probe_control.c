@@ -8,6 +8,9 @@
  *
  * Build: gcc probe_control.c -o probe_control -lusb-1.0
  * Run: sudo ./probe_control
+ *
+ * Timing: build with `make TRACE=1` to record a span per phase, request,
+ * transfer and output block into trace.json (see trace.h).
  */
 
 #include <libusb-1.0/libusb.h>
@@ -16,6 +19,8 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "trace.h"
+
 #define VID 0x2541
 #define PID 0xfa03
 
@@ -29,64 +34,103 @@ void print_hex(const char *label, const unsigned char *data, int len) {
 
 int vendor_read(libusb_device_handle *handle, uint8_t request, uint16_t value, uint16_t index,
                 unsigned char *data, uint16_t length, const char *description) {
+    TRACE_BEGINF("request", "vendor_read", "req=0x%02X value=0x%04X index=0x%04X len=%d",
+                 request, value, index, length);
+
+    TRACE_BEGIN("output", "print");
     printf("\n--- Vendor Read: %s ---\n", description);
     printf("Request: 0x%02X, Value: 0x%04X, Index: 0x%04X, Length: %d\n",
            request, value, index, length);
+    TRACE_END();
 
+    uint64_t start = TRACE_NOW();
     int ret = libusb_control_transfer(handle,
                                       LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
                                       request, value, index, data, length, 1000);
+    TRACE_COMPLETEF("transfer", "control_in", start, "%s, %d bytes",
+                    libusb_error_name(ret < 0 ? ret : 0), ret < 0 ? 0 : ret);
 
+    TRACE_BEGIN("output", "print");
     if (ret < 0) {
         printf("ERROR: %s (%d)\n", libusb_error_name(ret), ret);
-        return ret;
+    } else {
+        printf("SUCCESS: Received %d bytes\n", ret);
+        if (ret > 0) {
+            print_hex("Data", data, ret);
+        }
     }
+    TRACE_END();
 
-    printf("SUCCESS: Received %d bytes\n", ret);
-    if (ret > 0) {
-        print_hex("Data", data, ret);
-    }
+    TRACE_END();
     return ret;
 }
 
 int vendor_write(libusb_device_handle *handle, uint8_t request, uint16_t value, uint16_t index,
                  unsigned char *data, uint16_t length, const char *description) {
+    TRACE_BEGINF("request", "vendor_write", "req=0x%02X value=0x%04X index=0x%04X len=%d",
+                 request, value, index, length);
+
+    TRACE_BEGIN("output", "print");
     printf("\n--- Vendor Write: %s ---\n", description);
     printf("Request: 0x%02X, Value: 0x%04X, Index: 0x%04X, Length: %d\n",
            request, value, index, length);
     if (length > 0) {
         print_hex("Sending", data, length);
     }
+    TRACE_END();
 
+    uint64_t start = TRACE_NOW();
     int ret = libusb_control_transfer(handle,
                                       LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
                                       request, value, index, data, length, 1000);
+    TRACE_COMPLETEF("transfer", "control_out", start, "%s, %d bytes",
+                    libusb_error_name(ret < 0 ? ret : 0), ret < 0 ? 0 : ret);
 
+    TRACE_BEGIN("output", "print");
     if (ret < 0) {
         printf("ERROR: %s (%d)\n", libusb_error_name(ret), ret);
-        return ret;
+    } else {
+        printf("SUCCESS: Sent %d bytes\n", ret);
     }
+    TRACE_END();
 
-    printf("SUCCESS: Sent %d bytes\n", ret);
+    TRACE_END();
     return ret;
 }
 
 int bulk_read(libusb_device_handle *handle, uint8_t endpoint, unsigned char *data,
               int length, const char *description) {
+    TRACE_BEGINF("request", "bulk_read", "ep=0x%02X len=%d", endpoint, length);
+
+    TRACE_BEGIN("output", "print");
     printf("\n--- Bulk Read from 0x%02X: %s ---\n", endpoint, description);
-    int transferred;
+    TRACE_END();
+
+    int transferred = 0;
+    uint64_t start = TRACE_NOW();
     int ret = libusb_bulk_transfer(handle, endpoint, data, length, &transferred, 1000);
+    TRACE_COMPLETEF("transfer", "bulk_in", start, "ep=0x%02X %s, %d bytes",
+                    endpoint, libusb_error_name(ret), transferred);
 
+    TRACE_BEGIN("output", "print");
     if (ret < 0) {
         printf("ERROR: %s (%d)\n", libusb_error_name(ret), ret);
-        return ret;
+    } else {
+        printf("SUCCESS: Received %d bytes\n", transferred);
+        if (transferred > 0) {
+            print_hex("Data", data, transferred);
+        }
     }
+    TRACE_END();
 
-    printf("SUCCESS: Received %d bytes\n", transferred);
-    if (transferred > 0) {
-        print_hex("Data", data, transferred);
-    }
-    return transferred;
+    TRACE_END();
+    return ret < 0 ? ret : transferred;
+}
+
+void pause_us(useconds_t usec) {
+    TRACE_BEGINF("sleep", "usleep", "%u us", (unsigned)usec);
+    usleep(usec);
+    TRACE_END();
 }
 
 int main(void) {
@@ -99,10 +143,12 @@ int main(void) {
     printf("=======================================================\n\n");
 
     // Initialize
+    TRACE_BEGIN("phase", "Setup");
     libusb_init(&ctx);
     handle = libusb_open_device_with_vid_pid(ctx, VID, PID);
     if (!handle) {
         fprintf(stderr, "Failed to open device\n");
+        TRACE_END();
         libusb_exit(ctx);
         return 1;
     }
@@ -114,9 +160,11 @@ int main(void) {
     libusb_claim_interface(handle, 0);
 
     printf("Device opened and interface claimed\n");
+    TRACE_END();
 
     // Test the working vendor requests in detail
     printf("\n=== PHASE 1: Known Working Requests ===\n");
+    TRACE_BEGIN("phase", "Phase 1: Known Working Requests");
 
     memset(buffer, 0, sizeof(buffer));
     vendor_read(handle, 0x06, 0x0000, 0x0000, buffer, 64, "Request 0x06 (Status?)");
@@ -128,27 +176,36 @@ int main(void) {
     memset(buffer, 0, sizeof(buffer));
     bulk_read(handle, 0x82, buffer, 512, "Spontaneous data check");
 
+    TRACE_END();
+
     // Try variations of working requests
     printf("\n=== PHASE 2: Exploring Request 0x06 Variations ===\n");
+    TRACE_BEGIN("phase", "Phase 2: Request 0x06 Variations");
     for (int val = 0; val < 4; val++) {
         memset(buffer, 0, sizeof(buffer));
         char desc[64];
         snprintf(desc, sizeof(desc), "Request 0x06 with value 0x%04X", val);
         vendor_read(handle, 0x06, val, 0, buffer, 64, desc);
-        usleep(100000);
+        pause_us(100000);
     }
 
+    TRACE_END();
+
     printf("\n=== PHASE 3: Exploring Request 0x07 Variations ===\n");
+    TRACE_BEGIN("phase", "Phase 3: Request 0x07 Variations");
     for (int val = 0; val < 4; val++) {
         memset(buffer, 0, sizeof(buffer));
         char desc[64];
         snprintf(desc, sizeof(desc), "Request 0x07 with value 0x%04X", val);
         vendor_read(handle, 0x07, val, 0, buffer, 64, desc);
-        usleep(100000);
+        pause_us(100000);
     }
 
+    TRACE_END();
+
     // Try vendor writes to see if we can send commands
     printf("\n=== PHASE 4: Testing Vendor Writes ===\n");
+    TRACE_BEGIN("phase", "Phase 4: Vendor Writes");
 
     // Try simple vendor write with request 0x01 (common init command)
     unsigned char init_data[] = {0x01, 0x00, 0x00, 0x00};
@@ -172,8 +229,11 @@ int main(void) {
     memset(buffer, 0, sizeof(buffer));
     bulk_read(handle, 0x82, buffer, 512, "Response after write to 0x06");
 
+    TRACE_END();
+
     // Explore more vendor request numbers
     printf("\n=== PHASE 5: Extended Vendor Request Scan ===\n");
+    TRACE_BEGIN("phase", "Phase 5: Extended Vendor Request Scan");
     for (int req = 0x10; req < 0x20; req++) {
         memset(buffer, 0, sizeof(buffer));
         char desc[64];
@@ -182,11 +242,14 @@ int main(void) {
         if (ret > 0) {
             printf("*** FOUND ANOTHER WORKING REQUEST! ***\n");
         }
-        usleep(100000);
+        pause_us(100000);
     }
 
+    TRACE_END();
+
     // Final status check
     printf("\n=== PHASE 6: Final Status ===\n");
+    TRACE_BEGIN("phase", "Phase 6: Final Status");
     memset(buffer, 0, sizeof(buffer));
     vendor_read(handle, 0x06, 0x0000, 0x0000, buffer, 64, "Final status check");
 
@@ -196,10 +259,14 @@ int main(void) {
     memset(buffer, 0, sizeof(buffer));
     bulk_read(handle, 0x82, buffer, 512, "Final bulk read");
 
+    TRACE_END();
+
     // Cleanup
+    TRACE_BEGIN("phase", "Cleanup");
     libusb_release_interface(handle, 0);
     libusb_close(handle);
     libusb_exit(ctx);
+    TRACE_END();
 
     printf("\n=== Exploration Complete ===\n");
     printf("Review the output above for patterns.\n");
@@ -0,0 +1,270 @@
+/*
+ * Lightweight Span Tracing
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Each thread owns a fixed-size ring of completed spans and a small stack
+ * of open ones, so recording never takes a lock. Only ring creation and
+ * the export at exit touch the shared registry. When a ring wraps, the
+ * oldest spans are dropped and the count is reported in the trace.
+ *
+ * Output format: Chrome Trace Event JSON ("X" complete events and "i"
+ * instant events, microsecond timestamps on CLOCK_MONOTONIC).
+ */
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_MAX_THREADS 64
+#define TRACE_DEFAULT_FILE "trace.json"
+
+typedef struct {
+    uint64_t ts;
+    uint64_t dur;
+    const char *cat;
+    const char *name;
+    char ph;
+    char args[TRACE_ARGS_LEN];
+} trace_event_t;
+
+typedef struct {
+    uint64_t ts;
+    const char *cat;
+    const char *name;
+    char args[TRACE_ARGS_LEN];
+} trace_open_span_t;
+
+typedef struct {
+    int tid;
+    uint64_t head;      // Total events ever written; slot is head % size
+    uint64_t dropped;
+    int depth;
+    trace_open_span_t stack[TRACE_MAX_DEPTH];
+    trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t *registry[TRACE_MAX_THREADS];
+static int registry_count;
+static __thread trace_ring_t *local_ring;
+
+static void trace_flush_at_exit(void) {
+    const char *path = getenv("TRACE_FILE");
+    trace_flush(path && *path ? path : TRACE_DEFAULT_FILE);
+}
+
+static trace_ring_t *get_ring(void) {
+    if (local_ring) {
+        return local_ring;
+    }
+
+    trace_ring_t *ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    if (registry_count == TRACE_MAX_THREADS) {
+        pthread_mutex_unlock(&registry_lock);
+        free(ring);
+        return NULL;
+    }
+    if (registry_count == 0) {
+        atexit(trace_flush_at_exit);
+    }
+    ring->tid = registry_count + 1;
+    registry[registry_count++] = ring;
+    pthread_mutex_unlock(&registry_lock);
+
+    local_ring = ring;
+    return ring;
+}
+
+static void format_args(char *dst, const char *fmt, va_list ap) {
+    if (fmt) {
+        vsnprintf(dst, TRACE_ARGS_LEN, fmt, ap);
+    } else {
+        dst[0] = '\0';
+    }
+}
+
+static trace_event_t *push_event(trace_ring_t *ring) {
+    trace_event_t *ev = &ring->events[ring->head % TRACE_RING_EVENTS];
+    if (ring->head >= TRACE_RING_EVENTS) {
+        ring->dropped++;
+    }
+    ring->head++;
+    return ev;
+}
+
+uint64_t trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void trace_begin(const char *cat, const char *name, const char *fmt, ...) {
+    trace_ring_t *ring = get_ring();
+    if (!ring) {
+        return;
+    }
+
+    // Spans nested deeper than the stack are counted but not recorded
+    if (ring->depth >= TRACE_MAX_DEPTH) {
+        ring->depth++;
+        ring->dropped++;
+        return;
+    }
+
+    trace_open_span_t *span = &ring->stack[ring->depth++];
+    span->cat = cat;
+    span->name = name;
+
+    va_list ap;
+    va_start(ap, fmt);
+    format_args(span->args, fmt, ap);
+    va_end(ap);
+
+    span->ts = trace_now_us();
+}
+
+void trace_end(void) {
+    uint64_t now = trace_now_us();
+    trace_ring_t *ring = local_ring;
+    if (!ring || ring->depth == 0) {
+        return;
+    }
+    if (--ring->depth >= TRACE_MAX_DEPTH) {
+        return;
+    }
+
+    trace_open_span_t *span = &ring->stack[ring->depth];
+    trace_event_t *ev = push_event(ring);
+    ev->ph = 'X';
+    ev->ts = span->ts;
+    ev->dur = now - span->ts;
+    ev->cat = span->cat;
+    ev->name = span->name;
+    memcpy(ev->args, span->args, sizeof(ev->args));
+}
+
+void trace_complete(const char *cat, const char *name, uint64_t start_us,
+                    const char *fmt, ...) {
+    uint64_t now = trace_now_us();
+    trace_ring_t *ring = get_ring();
+    if (!ring) {
+        return;
+    }
+
+    trace_event_t *ev = push_event(ring);
+    ev->ph = 'X';
+    ev->ts = start_us;
+    ev->dur = now > start_us ? now - start_us : 0;
+    ev->cat = cat;
+    ev->name = name;
+
+    va_list ap;
+    va_start(ap, fmt);
+    format_args(ev->args, fmt, ap);
+    va_end(ap);
+}
+
+void trace_instant(const char *cat, const char *name, const char *fmt, ...) {
+    uint64_t now = trace_now_us();
+    trace_ring_t *ring = get_ring();
+    if (!ring) {
+        return;
+    }
+
+    trace_event_t *ev = push_event(ring);
+    ev->ph = 'i';
+    ev->ts = now;
+    ev->dur = 0;
+    ev->cat = cat;
+    ev->name = name;
+
+    va_list ap;
+    va_start(ap, fmt);
+    format_args(ev->args, fmt, ap);
+    va_end(ap);
+}
+
+static void write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void write_event(FILE *f, int pid, int tid, const trace_event_t *ev) {
+    fprintf(f, ",\n{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%llu,",
+            ev->ph, pid, tid, (unsigned long long)ev->ts);
+    if (ev->ph == 'X') {
+        fprintf(f, "\"dur\":%llu,", (unsigned long long)ev->dur);
+    } else {
+        fprintf(f, "\"s\":\"t\",");
+    }
+    fprintf(f, "\"cat\":");
+    write_json_string(f, ev->cat);
+    fprintf(f, ",\"name\":");
+    write_json_string(f, ev->name);
+    if (ev->args[0]) {
+        fprintf(f, ",\"args\":{\"detail\":");
+        write_json_string(f, ev->args);
+        fputc('}', f);
+    }
+    fputc('}', f);
+}
+
+int trace_flush(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "trace: cannot write %s\n", path);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    uint64_t total = 0;
+
+    pthread_mutex_lock(&registry_lock);
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+               "\"args\":{\"name\":\"2541:fa03\"}}", pid);
+
+    for (int i = 0; i < registry_count; i++) {
+        trace_ring_t *ring = registry[i];
+        uint64_t count = ring->head < TRACE_RING_EVENTS ? ring->head : TRACE_RING_EVENTS;
+        uint64_t first = ring->head - count;
+
+        fprintf(f, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\","
+                   "\"args\":{\"name\":\"thread %d\",\"dropped\":%llu}}",
+                pid, ring->tid, ring->tid, (unsigned long long)ring->dropped);
+
+        for (uint64_t n = first; n < ring->head; n++) {
+            write_event(f, pid, ring->tid, &ring->events[n % TRACE_RING_EVENTS]);
+        }
+        total += count;
+    }
+
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&registry_lock);
+
+    fclose(f);
+    fprintf(stderr, "trace: wrote %llu events to %s\n", (unsigned long long)total, path);
+    return 0;
+}
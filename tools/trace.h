@@ -0,0 +1,67 @@
+/*
+ * Lightweight Span Tracing
+ *
+ * For Realtek/Microctopus MoC (USB ID 2541:fa03)
+ *
+ * Records nested spans (phases, requests, transfers) into per-thread
+ * ring buffers and writes them out as Chrome trace JSON at exit, which
+ * loads directly in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Without ENABLE_TRACE every TRACE_* macro expands to nothing, so the
+ * instrumentation costs nothing in normal builds.
+ *
+ * Build: make TRACE=1
+ * Run: sudo TRACE_FILE=probe_control.json ./probe_control
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#ifdef ENABLE_TRACE
+
+#define TRACE_RING_EVENTS 8192  // Completed spans kept per thread
+#define TRACE_MAX_DEPTH 32      // Open spans per thread
+#define TRACE_ARGS_LEN 64       // Detail string stored with each span
+
+uint64_t trace_now_us(void);
+void trace_begin(const char *cat, const char *name, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void trace_end(void);
+void trace_complete(const char *cat, const char *name, uint64_t start_us,
+                    const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+void trace_instant(const char *cat, const char *name, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+int trace_flush(const char *path);
+
+// Span on the current thread's stack, closed by TRACE_END()
+#define TRACE_BEGIN(cat, name) trace_begin((cat), (name), NULL)
+#define TRACE_BEGINF(cat, name, ...) trace_begin((cat), (name), __VA_ARGS__)
+#define TRACE_END() trace_end()
+
+// Span with an explicit start, for work that begins in one callback and
+// ends in another (e.g. asynchronous transfer submit -> complete)
+#define TRACE_NOW() trace_now_us()
+#define TRACE_COMPLETE(cat, name, start) trace_complete((cat), (name), (start), NULL)
+#define TRACE_COMPLETEF(cat, name, start, ...) \
+    trace_complete((cat), (name), (start), __VA_ARGS__)
+
+#define TRACE_INSTANT(cat, name) trace_instant((cat), (name), NULL)
+#define TRACE_INSTANTF(cat, name, ...) trace_instant((cat), (name), __VA_ARGS__)
+
+#else
+
+#define TRACE_BEGIN(cat, name) do { } while (0)
+#define TRACE_BEGINF(cat, name, ...) do { } while (0)
+#define TRACE_END() do { } while (0)
+#define TRACE_NOW() ((uint64_t)0)
+#define TRACE_COMPLETE(cat, name, start) do { (void)(start); } while (0)
+#define TRACE_COMPLETEF(cat, name, start, ...) do { (void)(start); } while (0)
+#define TRACE_INSTANT(cat, name) do { } while (0)
+#define TRACE_INSTANTF(cat, name, ...) do { } while (0)
+
+#endif
+
+#endif